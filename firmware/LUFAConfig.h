@@ -76,8 +76,8 @@
 		#define FIXED_CONTROL_ENDPOINT_SIZE      64
 //		#define DEVICE_STATE_AS_GPIOR            {Insert Value Here}
 //		#define FIXED_NUM_CONFIGURATIONS         {Insert Value Here}
-		#define CONTROL_ONLY_DEVICE
-//		#define INTERRUPT_CONTROL_ENDPOINT
+//		#define CONTROL_ONLY_DEVICE
+		#define INTERRUPT_CONTROL_ENDPOINT
 //		#define NO_DEVICE_REMOTE_WAKEUP
 		#define NO_DEVICE_SELF_POWER
 
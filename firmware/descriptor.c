@@ -52,6 +52,63 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 
 		.MaxPowerConsumption    = USB_CONFIG_POWER_MA(50)
 	},
+
+	.Interface = {
+		.Header                 = {
+			.Size = sizeof(USB_Descriptor_Interface_t),
+			.Type = DTYPE_Interface
+		},
+
+		.InterfaceNumber        = 0,
+		.AlternateSetting       = 0,
+
+		.TotalEndpoints         = 3,
+
+		.Class                  = USB_CSCP_VendorSpecificClass,
+		.SubClass               = USB_CSCP_NoSpecificSubclass,
+		.Protocol               = USB_CSCP_NoSpecificProtocol,
+
+		.InterfaceStrIndex      = NO_DESCRIPTOR
+	},
+
+	.EventEndpoint = {
+		.Header                 = {
+			.Size = sizeof(USB_Descriptor_Endpoint_t),
+			.Type = DTYPE_Endpoint
+		},
+
+		.EndpointAddress        = EVENT_EPADDR,
+		.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC
+						| ENDPOINT_USAGE_DATA),
+		.EndpointSize           = EVENT_EPSIZE,
+		.PollingIntervalMS      = 1
+	},
+
+	.SetpointEndpoint = {
+		.Header                 = {
+			.Size = sizeof(USB_Descriptor_Endpoint_t),
+			.Type = DTYPE_Endpoint
+		},
+
+		.EndpointAddress        = SETPOINT_EPADDR,
+		.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC
+						| ENDPOINT_USAGE_DATA),
+		.EndpointSize           = SETPOINT_EPSIZE,
+		.PollingIntervalMS      = 1
+	},
+
+	.TraceEndpoint = {
+		.Header                 = {
+			.Size = sizeof(USB_Descriptor_Endpoint_t),
+			.Type = DTYPE_Endpoint
+		},
+
+		.EndpointAddress        = TRACE_EPADDR,
+		.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC
+						| ENDPOINT_USAGE_DATA),
+		.EndpointSize           = TRACE_EPSIZE,
+		.PollingIntervalMS      = 0
+	},
 };
 
 const USB_Descriptor_String_t PROGMEM LanguageString
@@ -14,8 +14,30 @@ extern USB_Descriptor_String_t	SerialNumberMemoryString;
 
 typedef struct {
 	USB_Descriptor_Configuration_Header_t Config;
+	USB_Descriptor_Interface_t	Interface;
+	USB_Descriptor_Endpoint_t	EventEndpoint;
+	USB_Descriptor_Endpoint_t	SetpointEndpoint;
+	USB_Descriptor_Endpoint_t	TraceEndpoint;
 } USB_Descriptor_Configuration_t;
 
+/**
+ * \brief Interrupt IN endpoint used to send event records to the host
+ */
+#define	EVENT_EPADDR	(ENDPOINT_DIR_IN | 1)
+#define	EVENT_EPSIZE	8
+
+/**
+ * \brief Interrupt OUT endpoint used to receive setpoints from the host
+ */
+#define	SETPOINT_EPADDR	(ENDPOINT_DIR_OUT | 2)
+#define	SETPOINT_EPSIZE	8
+
+/**
+ * \brief Bulk IN endpoint used to send the motion trace to the host
+ */
+#define	TRACE_EPADDR	(ENDPOINT_DIR_IN | 3)
+#define	TRACE_EPSIZE	32
+
 enum StringDescriptors_t {
 	STRING_ID_Language     = 0,
 	STRING_ID_Manufacturer = 1,
@@ -4,7 +4,11 @@
  * (c) 2018 Prof Dr Andreas Müller, Hochschule Rapperswil
  */
 #include <eeprom.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "motor.h"
+#include "journal.h"
+#include "settings.h"
 #include "config.h"
 
 uint32_t        EEMEM   position = 0x800000;
@@ -13,5 +17,137 @@ uint32_t        EEMEM   position = 0x800000;
 USB_Descriptor_String_t EEMEM SerialNumberString
 	= USB_STRING_DESCRIPTOR(FOCUSER_SERIAL);
 
+// the following cells are only read once to build the configuration
+// block when upgrading from firmware that did not have it
 uint8_t	EEMEM	topspeed = STEP_FULL;
 
+
+uint16_t	EEMEM	backlash = 0;
+uint8_t	EEMEM	backlashdir = BACKLASH_UP;
+
+uint16_t	EEMEM	savedelay = SAVEDELAY_DEFAULT;
+
+// position journal, the records in the EEPROM image are all zero and
+// thus invalid, so the position cell above is used until the first
+// record has been written
+journal_record_t	EEMEM	journal[JOURNAL_SIZE];
+
+// configuration block, the image contains no valid block, so it is
+// built from the cells above at the first boot
+settings_t	EEMEM	settingsblock;
+
+/*
+ * Writing a byte to the EEPROM takes several milliseconds, so writes are
+ * not done synchronously. Instead the blocks to write are queued, each
+ * with its start address and length, and their data goes into a ring
+ * buffer. The EEPROM ready interrupt writes one byte whenever the
+ * EEPROM is idle. Only the main loop queues blocks, so it owns the
+ * tails, and only the interrupt removes bytes, so it owns the heads.
+ * The lengths shared by both are only changed with interrupts disabled.
+ */
+#define	EEPROM_QUEUE_SIZE	24	/* data bytes */
+#define	EEPROM_BLOCKS		4	/* blocks, a power of two */
+
+static uint8_t	queue_data[EEPROM_QUEUE_SIZE];
+static uint8_t	queue_head = 0;
+static uint8_t	queue_tail = 0;
+static volatile uint8_t	queue_length = 0;
+static uint16_t	block_address[EEPROM_BLOCKS];
+static uint8_t	block_length[EEPROM_BLOCKS];
+static uint8_t	block_head = 0;
+static uint8_t	block_tail = 0;
+static volatile uint8_t	block_count = 0;
+static volatile uint16_t	completed = 0;
+
+/**
+ * \brief Queue a block of data for writing to the EEPROM
+ *
+ * The data is copied, so the source may change after the call. Either
+ * the whole block is queued or nothing. The copy is done with interrupts
+ * enabled, into room the interrupt does not touch, so this may only be
+ * called from the main loop.
+ *
+ * \return	1 if the block was queued, 0 if the queue has no room for it
+ */
+uint8_t	eeprom_enqueue(void *dst, const void *src, uint8_t length) {
+	if (0 == length) {
+		return 1;
+	}
+	// the interrupt only makes room, so room found here stays free
+	if ((block_count == EEPROM_BLOCKS)
+		|| (queue_length + length > EEPROM_QUEUE_SIZE)) {
+		return 0;
+	}
+	const uint8_t	*s = (const uint8_t *)src;
+	uint8_t	i = queue_tail;
+	for (uint8_t n = length; n; n--) {
+		queue_data[i] = *s++;
+		if (++i == EEPROM_QUEUE_SIZE) {
+			i = 0;
+		}
+	}
+	queue_tail = i;
+	block_address[block_tail] = (uint16_t)dst;
+	block_length[block_tail] = length;
+	block_tail = (block_tail + 1) & (EEPROM_BLOCKS - 1);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		queue_length += length;
+		block_count++;
+		EECR |= _BV(EERIE);
+	}
+	return 1;
+}
+
+/**
+ * \brief Number of bytes waiting to be written to the EEPROM
+ */
+uint8_t	eeprom_pending() {
+	return queue_length;
+}
+
+/**
+ * \brief Number of bytes written to the EEPROM since reset
+ */
+uint16_t	eeprom_completed() {
+	uint16_t	result;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		result = completed;
+	}
+	return result;
+}
+
+/**
+ * \brief EEPROM ready interrupt
+ *
+ * Takes the next byte from the queue and writes it, unless it already
+ * has the right value, so it doesn't wear the EEPROM. At most one byte
+ * is handled per interrupt, so the step interrupt never waits for more
+ * than one byte. The interrupt is level triggered, so a skipped byte
+ * is followed by the next interrupt right away. When the queue is
+ * empty, the interrupt is disabled.
+ */
+ISR(EE_READY_vect) {
+	if (0 == block_count) {
+		EECR &= ~_BV(EERIE);
+		return;
+	}
+	uint16_t	address = block_address[block_head];
+	uint8_t	data = queue_data[queue_head];
+	if (++queue_head == EEPROM_QUEUE_SIZE) {
+		queue_head = 0;
+	}
+	queue_length--;
+	block_address[block_head] = address + 1;
+	if (0 == --block_length[block_head]) {
+		block_head = (block_head + 1) & (EEPROM_BLOCKS - 1);
+		block_count--;
+	}
+	EEAR = address;
+	EECR |= _BV(EERE);
+	if (EEDR != data) {
+		EEDR = data;
+		EECR |= _BV(EEMPE);
+		EECR |= _BV(EEPE);
+		completed++;
+	}
+}
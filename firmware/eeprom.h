@@ -8,9 +8,20 @@
 
 #include <avr/pgmspace.h>
 #include <LUFA/Drivers/USB/USB.h>
+#include <journal.h>
+#include <settings.h>
 
 extern uint32_t EEMEM	position;
 extern USB_Descriptor_String_t EEMEM	SerialNumberString;
 extern uint8_t	EEMEM	topspeed;	
+extern uint16_t	EEMEM	backlash;
+extern uint8_t	EEMEM	backlashdir;
+extern uint16_t	EEMEM	savedelay;
+extern journal_record_t	EEMEM	journal[JOURNAL_SIZE];
+extern settings_t	EEMEM	settingsblock;
+
+extern uint8_t	eeprom_enqueue(void *dst, const void *src, uint8_t length);
+extern uint8_t	eeprom_pending();
+extern uint16_t	eeprom_completed();
 
 #endif /* _eeprom_h */
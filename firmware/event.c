@@ -10,9 +10,18 @@
 #include <receiver.h>
 #include <LUFA/Drivers/USB/Core/Events.h>
 #include <avr/wdt.h>
+#include <util/atomic.h>
 #include <motor.h>
 #include <timer.h>
 #include <serial.h>
+#include <program.h>
+#include <descriptor.h>
+#include <eeprom.h>
+#include <settings.h>
+#include <task.h>
+#include <setpoint.h>
+#include <trace.h>
+#include <stats.h>
 
 /**
  * \brief RESET request
@@ -23,6 +32,7 @@
 void	process_reset() {
 	Endpoint_ClearSETUP();
 	Endpoint_ClearStatusStage();
+	stats_resetrequest();
 	// the usual method to set the watchdog timer timeout to
 	// a short time does not really work, because interrupts happen
 	// so often in this application. We use the reset flag from
@@ -52,10 +62,49 @@ void	process_set() {
 	if ((position == 0) || (position == 0xffffff)) {
 		return;
 	}
+	program_cancel();
 	motor_moveto(position,
 		(USB_ControlRequest.wIndex) ? SPEED_FAST : SPEED_SLOW);
 }
 
+/**
+ * \brief MOVE request
+ *
+ * The MOVE request changes the target by the signed 24 bit delta in the
+ * data stage. The firmware computes the new target from the current one,
+ * so there is no need to read the target first. Like SET, a nonzero
+ * wIndex selects high speed.
+ */
+void	process_move() {
+	int32_t	delta = 0;
+	Endpoint_ClearSETUP();
+	Endpoint_Read_Control_Stream_LE((void *)&delta, sizeof(delta));
+	Endpoint_ClearIN();
+	// ignore deltas that do not fit into 24 bits
+	if ((delta < -0x800000) || (delta > 0x7fffff)) {
+		return;
+	}
+	program_cancel();
+	motor_move(delta,
+		(USB_ControlRequest.wIndex) ? SPEED_FAST : SPEED_SLOW);
+}
+
+/**
+ * \brief VELOCITY request
+ *
+ * The data stage contains the signed velocity (32 bit) in 1/1000 full
+ * steps per second. The motor keeps moving at that velocity until it is
+ * stopped, a new target is set, or a velocity of 0 is requested.
+ */
+void	process_velocity() {
+	int32_t	velocity = 0;
+	Endpoint_ClearSETUP();
+	Endpoint_Read_Control_Stream_LE((void *)&velocity, sizeof(velocity));
+	Endpoint_ClearIN();
+	program_cancel();
+	motor_velocity(velocity);
+}
+
 /**
  * \brief LOCK request
  *
@@ -79,6 +128,7 @@ void	process_lock() {
 void	process_stop() {
 	Endpoint_ClearSETUP();
 	Endpoint_ClearStatusStage();
+	program_cancel();
 	motor_stop();
 }
 
@@ -96,13 +146,13 @@ void	process_serial() {
 	}
 	Endpoint_ClearIN();
 	serialbuffer[l] = '\0';
-	newserial = 1;
+	task_post(TASK_SERIAL);
 }
 
 /**
  * \brief POSITION request
  *
- * sets the position to a specific value
+ * sets the position to a specific value, the main loop saves it
  */
 void	process_position() {
 	Endpoint_ClearSETUP();
@@ -114,7 +164,7 @@ void	process_position() {
 		return;
 	}
 	motor_position(zeroposition);
-	motor_save();
+	task_post(TASK_SAVE);
 }
 
 /**
@@ -129,6 +179,102 @@ void	process_set_topspeed() {
 	motor_set_topspeed(settopspeed);
 }
 
+/**
+ * \brief set BACKLASH request
+ *
+ * The data stage contains the number of steps to overshoot (16 bit)
+ * followed by the direction byte for the final approach, 1 for up,
+ * 0 for down.
+ */
+void	process_set_backlash() {
+	Endpoint_ClearSETUP();
+	uint8_t	v[3] = { 0, 0, BACKLASH_UP };
+	Endpoint_Read_Control_Stream_LE((void *)v, sizeof(v));
+	Endpoint_ClearIN();
+	motor_set_backlash(v[0] | (v[1] << 8), v[2]);
+}
+
+/**
+ * \brief PROGRAM request
+ *
+ * The data stage contains up to PROGRAM_SIZE segments, each consisting
+ * of a 24 bit position, a speed byte and a 16 bit dwell time in
+ * milliseconds. The segments are executed back to back, a request
+ * without data cancels a running program. A request whose length is
+ * not a whole number of segments is stalled and leaves a running
+ * program alone.
+ */
+void	process_program() {
+	uint16_t	l = USB_ControlRequest.wLength;
+	// refuse a data stage that is not a whole number of segments, the
+	// SETUP packet is cleared by LUFA after the stall
+	if ((l > sizeof(program)) || (l % sizeof(program_segment_t))) {
+		Endpoint_StallTransaction();
+		return;
+	}
+	Endpoint_ClearSETUP();
+	program_cancel();
+	Endpoint_Read_Control_Stream_LE((void *)program, l);
+	Endpoint_ClearIN();
+	program_load(l / sizeof(program_segment_t));
+}
+
+/**
+ * \brief set SAVEDELAY request
+ *
+ * The data stage contains the number of seconds (16 bit) the motor has
+ * to be idle before the position is saved to the EEPROM.
+ */
+void	process_set_savedelay() {
+	Endpoint_ClearSETUP();
+	uint16_t	seconds = 0;
+	Endpoint_Read_Control_Stream_LE((void *)&seconds, sizeof(seconds));
+	Endpoint_ClearIN();
+	motor_set_savedelay(seconds);
+}
+
+/**
+ * \brief set SETTINGS request
+ *
+ * The data stage contains the complete configuration block as defined
+ * in settings.h. The version and crc fields are ignored, the firmware
+ * fills them in. A data stage of the wrong length is stalled right
+ * away, a block containing invalid values is ignored as a whole and
+ * the status stage is stalled, so the host sees the failure.
+ */
+void	process_set_settings() {
+	if (USB_ControlRequest.wLength != sizeof(settings_t)) {
+		Endpoint_StallTransaction();
+		return;
+	}
+	Endpoint_ClearSETUP();
+	settings_t	s;
+	if (Endpoint_Read_Control_Stream_LE((void *)&s, sizeof(s))
+		!= ENDPOINT_RWCSTREAM_NoError) {
+		return;
+	}
+	if (!settings_update(&s)) {
+		Endpoint_StallTransaction();
+		return;
+	}
+	Endpoint_ClearIN();
+}
+
+/**
+ * \brief TRACE request
+ *
+ * A nonzero wIndex starts the motion trace on the bulk IN endpoint,
+ * zero stops it. Starting the trace resets the lost record counter.
+ */
+void	process_trace() {
+	Endpoint_ClearSETUP();
+	Endpoint_ClearStatusStage();
+	trace_enable((USB_ControlRequest.wIndex) ? 1 : 0);
+	if (trace_enabled) {
+		event_sof_enable();
+	}
+}
+
 #define	is_control() \
 	((USB_ControlRequest.bmRequestType & CONTROL_REQTYPE_TYPE) 	\
 		== REQTYPE_VENDOR) 					\
@@ -147,15 +293,20 @@ void	process_set_topspeed() {
 /**
  * \brief Get the current focuser state
  *
- * The GET request returns a single byte containing the state of all
- * the output ports.
+ * The GET request returns current position, target and speed, followed
+ * by the index of the active motion program segment (-1 if no program
+ * is running). Hosts that only ask for the first three values get the
+ * same answer as from older firmware.
  */
 void	process_get() {
 	Endpoint_ClearSETUP();
-	int32_t	v[3];
-	v[0] = motor_current();
-	v[1] = motor_target();
+	int32_t	v[4];
+	motor_status_t	status;
+	motor_status(&status);
+	v[0] = status.current;
+	v[1] = status.target;
 	v[2] = motor_speed();
+	v[3] = program_current();
 	Endpoint_Write_Control_Stream_LE((void *)v, sizeof(v));
 	Endpoint_ClearOUT();
 }
@@ -177,7 +328,7 @@ void	process_rcvr() {
  */
 void	process_saved() {
 	Endpoint_ClearSETUP();
-	uint32_t	v = lastsaved;
+	uint32_t	v = motor_lastsaved();
 	Endpoint_Write_Control_Stream_LE((void *)&v, sizeof(v));
 	Endpoint_ClearOUT();
 }
@@ -192,6 +343,251 @@ void	process_get_topspeed() {
 	Endpoint_ClearOUT();
 }
 
+/**
+ * \brief get BACKLASH implementation
+ */
+void	process_get_backlash() {
+	Endpoint_ClearSETUP();
+	uint16_t	steps = motor_get_backlash();
+	uint8_t	v[3];
+	v[0] = steps & 0xff;
+	v[1] = steps >> 8;
+	v[2] = motor_get_backlashdir();
+	Endpoint_Write_Control_Stream_LE((void *)v, sizeof(v));
+	Endpoint_ClearOUT();
+}
+
+/**
+ * \brief get SAVEDELAY implementation
+ */
+void	process_get_savedelay() {
+	Endpoint_ClearSETUP();
+	uint16_t	seconds = motor_get_savedelay();
+	Endpoint_Write_Control_Stream_LE((void *)&seconds, sizeof(seconds));
+	Endpoint_ClearOUT();
+}
+
+/**
+ * \brief get SETTINGS implementation
+ *
+ * Returns the configuration block currently in use.
+ */
+void	process_get_settings() {
+	Endpoint_ClearSETUP();
+	settings_t	s = settings;
+	Endpoint_Write_Control_Stream_LE((void *)&s, sizeof(s));
+	Endpoint_ClearOUT();
+}
+
+/**
+ * \brief get TRACE implementation
+ *
+ * Returns the number of trace records dropped since the trace was
+ * started (16 bit), followed by a byte that is 1 while tracing.
+ */
+void	process_get_trace() {
+	Endpoint_ClearSETUP();
+	uint16_t	lost = trace_lost();
+	uint8_t	v[3];
+	v[0] = lost & 0xff;
+	v[1] = lost >> 8;
+	v[2] = trace_enabled;
+	Endpoint_Write_Control_Stream_LE((void *)v, sizeof(v));
+	Endpoint_ClearOUT();
+}
+
+/**
+ * \brief STATS request implementation
+ *
+ * Returns the performance counters as described in stats.h, a nonzero
+ * wIndex clears them after reading. This runs in the USB interrupt,
+ * which the step interrupt can preempt, so the counters are written to
+ * the endpoint one by one instead of being collected in a buffer on the
+ * stack. They fit into a single packet, a host asking for fewer bytes
+ * gets a stall.
+ */
+void	process_stats() {
+	if (USB_ControlRequest.wLength < STATS_SIZE) {
+		Endpoint_StallTransaction();
+		return;
+	}
+	Endpoint_ClearSETUP();
+	while (!Endpoint_IsINReady()) {
+		if (USB_DeviceState == DEVICE_STATE_Unattached) {
+			return;
+		}
+	}
+	stats_write((USB_ControlRequest.wIndex) ? 1 : 0);
+	Endpoint_ClearIN();
+	Endpoint_ClearStatusStage();
+}
+
+_Static_assert(STATUS_SIZE < FIXED_CONTROL_ENDPOINT_SIZE,
+	"STATUS reply does not fit into one control packet");
+
+/**
+ * \brief Write a little endian field of the STATUS reply to the endpoint
+ *
+ * Bytes beyond the room the host asked for are dropped.
+ */
+static void	status_put(uint8_t *room, uint32_t value, uint8_t size) {
+	while (size--) {
+		if (*room) {
+			Endpoint_Write_8(value & 0xff);
+			(*room)--;
+		}
+		value >>= 8;
+	}
+}
+
+/**
+ * \brief STATUS request implementation
+ *
+ * Returns all fields selected by the bit mask in wIndex in a single
+ * transfer, see event.h for the field layout. Like the STATS reply, the
+ * fields are written to the endpoint one by one instead of being
+ * collected in a buffer on the stack. All fields together fit into a
+ * single packet.
+ */
+void	process_status() {
+	Endpoint_ClearSETUP();
+	uint16_t	fields = USB_ControlRequest.wIndex;
+	uint8_t	room = (USB_ControlRequest.wLength < STATUS_SIZE)
+			? USB_ControlRequest.wLength : STATUS_SIZE;
+	motor_status_t	status;
+	motor_status(&status);
+	while (!Endpoint_IsINReady()) {
+		if (USB_DeviceState == DEVICE_STATE_Unattached) {
+			return;
+		}
+	}
+	if (fields & STATUS_POSITION) {
+		status_put(&room, status.current, 4);
+	}
+	if (fields & STATUS_TARGET) {
+		status_put(&room, status.target, 4);
+	}
+	if (fields & STATUS_SPEED) {
+		status_put(&room, motor_speed(), 1);
+	}
+	if (fields & STATUS_MICROSTEP) {
+		status_put(&room, motor_microstep(), 1);
+		status_put(&room, motor_get_step(), 1);
+	}
+	if (fields & STATUS_RECEIVER) {
+		status_put(&room, recv_get(), 1);
+	}
+	if (fields & STATUS_SAVED) {
+		status_put(&room, motor_lastsaved(), 4);
+	}
+	if (fields & STATUS_TOPSPEED) {
+		status_put(&room, motor_get_topspeed(), 1);
+	}
+	if (fields & STATUS_UPTIME) {
+		status_put(&room, timer_uptime(), 4);
+	}
+	if (fields & STATUS_PROGRAM) {
+		status_put(&room, (uint8_t)program_current(), 1);
+	}
+	if (fields & STATUS_EEPROM) {
+		status_put(&room, eeprom_pending(), 1);
+		status_put(&room, eeprom_completed(), 2);
+	}
+	if (fields & STATUS_LATENCY) {
+		uint16_t	min, max;
+		timer_latency(&min, &max);
+		status_put(&room, min, 2);
+		status_put(&room, max, 2);
+	}
+	if (fields & STATUS_SETPOINT) {
+		status_put(&room, setpoint_sequence, 2);
+	}
+	Endpoint_ClearIN();
+	Endpoint_ClearStatusStage();
+}
+
+/**
+ * \brief Configuration changed event handler
+ *
+ * Sets up the interrupt endpoints for event records and setpoints and
+ * the bulk endpoint for the trace. A new configuration stops tracing,
+ * the host has to ask for it again.
+ */
+void	EVENT_USB_Device_ConfigurationChanged() {
+	Endpoint_ConfigureEndpoint(EVENT_EPADDR, EP_TYPE_INTERRUPT,
+		EVENT_EPSIZE, 1);
+	Endpoint_ConfigureEndpoint(SETPOINT_EPADDR, EP_TYPE_INTERRUPT,
+		SETPOINT_EPSIZE, 1);
+	Endpoint_ConfigureEndpoint(TRACE_EPADDR, EP_TYPE_BULK,
+		TRACE_EPSIZE, 1);
+	trace_enable(0);
+}
+
+/*
+ * The start of frame interrupt wakes up the CPU once per millisecond,
+ * which would keep the main loop from sleeping. It is therefore only
+ * enabled while a trace is running, or while setpoints arrive. When no
+ * setpoint has been applied for SOF_IDLE_FRAMES frames and no trace is
+ * running, it turns itself off again, and the setpoint endpoint is
+ * polled by the housekeeping tick until the next setpoint arrives.
+ */
+#define	SOF_IDLE_FRAMES	100
+static volatile uint8_t	sofidle = 0;
+
+/**
+ * \brief Poll the setpoint and trace endpoints in every frame
+ *
+ * This may be called from any context, the LUFA suspend and wake up
+ * handling changes the same interrupt enable register.
+ */
+void	event_sof_enable() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		sofidle = SOF_IDLE_FRAMES;
+		USB_Device_EnableSOFEvents();
+	}
+}
+
+/**
+ * \brief Start of frame event handler
+ *
+ * Wakes up the main loop to pick up setpoints and to send trace
+ * records, and turns the start of frame interrupt off when it is no
+ * longer needed.
+ */
+void	EVENT_USB_Device_StartOfFrame() {
+	task_post(TASK_SETPOINT | TASK_TRACE);
+	if (sofidle) {
+		sofidle--;
+	} else if (!trace_enabled) {
+		USB_Device_DisableSOFEvents();
+	}
+}
+
+/**
+ * \brief Suspend event handler
+ *
+ * The host stops talking to the device when it shuts down or goes to
+ * sleep, so this is a good moment to save the position.
+ */
+void	EVENT_USB_Device_Suspend() {
+	motor_flush();
+}
+
+/**
+ * \brief Disconnect event handler
+ *
+ * When a bus powered device is unplugged, it only runs for a few more
+ * milliseconds from the decoupling capacitors. A journal record takes
+ * five EEPROM writes of about 3.4 ms each, so the save usually does not
+ * complete, and the torn record is skipped at the next boot. The brown
+ * out detector cannot help, it only resets the chip. Positions are
+ * therefore protected by the short idle save delay, this save is a best
+ * effort for self powered setups.
+ */
+void	EVENT_USB_Device_Disconnect() {
+	motor_flush();
+}
+
 /**
  * \brief Control request event handler
  *
@@ -199,6 +595,7 @@ void	process_get_topspeed() {
  */
 void	EVENT_USB_Device_ControlRequest() {
 	if (is_control()) {
+		stats_request(USB_ControlRequest.bRequest);
 		if (is_incoming()) {
 			switch (USB_ControlRequest.bRequest) {
 			case FOCUSER_RESET:
@@ -222,6 +619,27 @@ void	EVENT_USB_Device_ControlRequest() {
 			case FOCUSER_TOPSPEED:
 				process_set_topspeed();
 				break;
+			case FOCUSER_BACKLASH:
+				process_set_backlash();
+				break;
+			case FOCUSER_PROGRAM:
+				process_program();
+				break;
+			case FOCUSER_MOVE:
+				process_move();
+				break;
+			case FOCUSER_SAVEDELAY:
+				process_set_savedelay();
+				break;
+			case FOCUSER_SETTINGS:
+				process_set_settings();
+				break;
+			case FOCUSER_VELOCITY:
+				process_velocity();
+				break;
+			case FOCUSER_TRACE:
+				process_trace();
+				break;
 			}
 		}
 		if (is_outgoing()) {
@@ -238,6 +656,24 @@ void	EVENT_USB_Device_ControlRequest() {
 			case FOCUSER_TOPSPEED:
 				process_get_topspeed();
 				break;
+			case FOCUSER_BACKLASH:
+				process_get_backlash();
+				break;
+			case FOCUSER_STATUS:
+				process_status();
+				break;
+			case FOCUSER_SAVEDELAY:
+				process_get_savedelay();
+				break;
+			case FOCUSER_SETTINGS:
+				process_get_settings();
+				break;
+			case FOCUSER_TRACE:
+				process_get_trace();
+				break;
+			case FOCUSER_STATS:
+				process_stats();
+				break;
 			}
 		}
 	}
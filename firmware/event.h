@@ -24,6 +24,41 @@
 #define FOCUSER_SERIAL	7
 #define FOCUSER_POSITION	8
 #define	FOCUSER_TOPSPEED	9
+#define	FOCUSER_BACKLASH	10
+#define	FOCUSER_PROGRAM	11
+#define	FOCUSER_STATUS	12
+#define	FOCUSER_MOVE	13
+#define	FOCUSER_SAVEDELAY	14
+#define	FOCUSER_SETTINGS	15
+#define	FOCUSER_VELOCITY	16
+#define	FOCUSER_TRACE	17
+#define	FOCUSER_STATS	18
+
+/**
+ * \brief Field selection bits for the STATUS request
+ *
+ * The wIndex field of the STATUS request selects the fields to return,
+ * the selected fields are sent in the order of their bits, packed and
+ * in little endian byte order. The size of each field is given in the
+ * comment.
+ */
+#define	STATUS_POSITION	0x0001	/* 4, current position */
+#define	STATUS_TARGET	0x0002	/* 4, target position */
+#define	STATUS_SPEED	0x0004	/* 1, speed, 0 = slow, 1 = fast */
+#define	STATUS_MICROSTEP	0x0008	/* 2, microstep phase, stepping mode */
+#define	STATUS_RECEIVER	0x0010	/* 1, receiver buttons, 0x80 = locked */
+#define	STATUS_SAVED	0x0020	/* 4, position last saved to EEPROM */
+#define	STATUS_TOPSPEED	0x0040	/* 1, top speed setting */
+#define	STATUS_UPTIME	0x0080	/* 4, seconds since reset */
+#define	STATUS_PROGRAM	0x0100	/* 1, active program segment or -1 */
+#define	STATUS_EEPROM	0x0200	/* 3, EEPROM bytes pending, bytes written */
+#define	STATUS_LATENCY	0x0400	/* 4, min and max step interrupt latency
+				   in timer ticks since the last query */
+#define	STATUS_SETPOINT	0x0800	/* 2, sequence number of the last applied
+				   setpoint packet */
+
+/* size of the reply with all fields selected */
+#define	STATUS_SIZE	31
 
 /**
  * \brief Event handle for control requests
@@ -35,4 +70,30 @@
  */
 extern void	EVENT_USB_Device_ControlRequest();
 
+/**
+ * \brief Event handler for configuration changes
+ *
+ * Configures the interrupt endpoint for event records.
+ */
+extern void	EVENT_USB_Device_ConfigurationChanged();
+
+/**
+ * \brief Event handler for the start of frame
+ *
+ * Posts the tasks that poll the setpoint and trace endpoints. The start
+ * of frame interrupt is only enabled by event_sof_enable() while it is
+ * needed.
+ */
+extern void	EVENT_USB_Device_StartOfFrame();
+extern void	event_sof_enable();
+
+/**
+ * \brief Event handlers for suspend and disconnect
+ *
+ * Both mark the position for saving, as the device may lose power.
+ * After a disconnect this is only a best effort, see event.c.
+ */
+extern void	EVENT_USB_Device_Suspend();
+extern void	EVENT_USB_Device_Disconnect();
+
 #endif /* _event_h */
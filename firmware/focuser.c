@@ -9,33 +9,32 @@
 #include <LUFA/Platform/Platform.h>
 #include <LUFA/Drivers/USB/USB.h>
 #include <avr/wdt.h>
-#include <util/delay.h>
+#include <avr/power.h>
 #include <timer.h>
-#include <led.h>
 #include <motor.h>
 #include <serial.h>
 #include <descriptor.h>
+#include <notify.h>
+#include <settings.h>
+#include <task.h>
+#include <stats.h>
 
 /**
  * \brief Main function for the focuser firmware
  */
 int	main(int argc, char *argv[]) {
-	// initialize the 
-	unsigned short	d = 10;
-	led_on();
-	while (d--) {
-		_delay_ms(100);
-		led_off();
-		_delay_ms(100);
-		led_on();
-	}
-	led_off();
-
-	// copy the serial number string into RAM
+	// load the configuration block and the serial number string
+	// into RAM, nothing reads the EEPROM after this point. This only
+	// takes microseconds, but must happen before the host asks for
+	// the descriptors
+	settings_read();
 	serial_read();
 
-	// initialize USB, but USB requests will only be handled when
-	// interrupts are enabled below
+	// initialize USB right away so that the host sees the device as
+	// soon as possible after a reset, USB requests will only be
+	// handled when interrupts are enabled below. The LED is switched
+	// on by led_setup() and the power on blink sequence is run by
+	// the timer.
 	USB_Init(USB_DEVICE_OPT_FULLSPEED);
 
 	// start the timer, this also enables the watchdog timer
@@ -44,16 +43,8 @@ int	main(int argc, char *argv[]) {
 	// enable interrupts so that USB processing can begin
 	GlobalInterruptEnable();
 
-	// do nothing	
-	for (;;) {
-		USB_USBTask();
-		if (saveneeded) {
-			motor_save();
-		}
-		if (newserial) {
-			serial_write();
-		}
-	}
+	// run deferred work posted by the interrupt handlers
+	task_loop();
 }
 
 void	 wdt_init(void) __attribute((naked)) __attribute((section(".init3")));
@@ -62,9 +53,31 @@ void	 wdt_init(void) __attribute((naked)) __attribute((section(".init3")));
  * \brief method to initialize the watchdog timer
  *
  * The attributes set for this function above are designed so that
- * the function is automatically called in the startup sequence.
+ * the function is automatically called in the startup sequence. The
+ * reset cause is counted before the flags are cleared.
  */
 void	wdt_init(void) {
+	stats_reset(MCUSR);
 	MCUSR = 0;
 	wdt_disable();
 }
+
+void	clock_init(void) __attribute((naked)) __attribute((section(".init3")));
+
+/**
+ * \brief Set the system clock prescaler
+ *
+ * The crystal runs at F_USB, the CKDIV8 fuse divides it by 8 at power
+ * on. Depending on the build configuration, the core either stays at
+ * that clock or runs at the full crystal frequency. This happens before
+ * the constructors, so the timers are set up for the final clock.
+ */
+void	clock_init(void) {
+#if (F_CPU == F_USB)
+	clock_prescale_set(clock_div_1);
+#elif (F_CPU * 8 == F_USB)
+	clock_prescale_set(clock_div_8);
+#else
+#error "F_CPU must be F_USB or F_USB / 8"
+#endif
+}
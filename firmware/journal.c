@@ -0,0 +1,86 @@
+/*
+ * journal.c -- wear leveled position journal in the EEPROM
+ *
+ * Instead of rewriting the same EEPROM cell, every saved position is
+ * written to the next record of a ring of JOURNAL_SIZE records. At boot,
+ * the newest valid record is the one whose successor is not valid or
+ * does not carry the next sequence number. Since the ring is much
+ * shorter than the sequence number range, this is unambiguous.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <journal.h>
+#include <eeprom.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+static uint8_t	journal_next = 0;
+static uint8_t	journal_sequence = 0;
+
+/**
+ * \brief Compute the checksum of a record
+ */
+static uint8_t	journal_crc(const journal_record_t *record) {
+	const uint8_t	*p = (const uint8_t *)record;
+	uint8_t	crc = 0xff;
+	for (uint8_t i = 0; i < 4; i++) {
+		crc = _crc8_ccitt_update(crc, p[i]);
+	}
+	return crc;
+}
+
+static uint8_t	journal_valid(const journal_record_t *record) {
+	return journal_crc(record) == record->crc;
+}
+
+/**
+ * \brief Find the newest position in the journal
+ *
+ * The scan reads every record exactly once. If the journal contains no
+ * valid record, e.g. after upgrading from firmware without journal, the
+ * position is taken from the old single position cell.
+ */
+uint32_t	journal_read() {
+	journal_record_t	record, next;
+	eeprom_read_block(&next, &journal[0], sizeof(next));
+	for (uint8_t i = 0; i < JOURNAL_SIZE; i++) {
+		record = next;
+		eeprom_read_block(&next, &journal[(i + 1) % JOURNAL_SIZE],
+			sizeof(next));
+		if (!journal_valid(&record)) {
+			continue;
+		}
+		if (journal_valid(&next)
+			&& (next.sequence == (uint8_t)(record.sequence + 1))) {
+			continue;
+		}
+		journal_next = (i + 1) % JOURNAL_SIZE;
+		journal_sequence = record.sequence + 1;
+		return record.position[0]
+			| ((uint32_t)record.position[1] << 8)
+			| ((uint32_t)record.position[2] << 16);
+	}
+	return eeprom_read_dword(&position);
+}
+
+/**
+ * \brief Queue a new position record for writing
+ *
+ * This is not reentrant, it must only be called from the main loop.
+ *
+ * \return	1 if the record was queued, 0 if the EEPROM queue is full
+ */
+uint8_t	journal_write(uint32_t position) {
+	journal_record_t	record;
+	record.sequence = journal_sequence;
+	record.position[0] = position & 0xff;
+	record.position[1] = (position >> 8) & 0xff;
+	record.position[2] = (position >> 16) & 0xff;
+	record.crc = journal_crc(&record);
+	if (!eeprom_enqueue(&journal[journal_next], &record, sizeof(record))) {
+		return 0;
+	}
+	journal_next = (journal_next + 1) % JOURNAL_SIZE;
+	journal_sequence++;
+	return 1;
+}
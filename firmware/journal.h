@@ -0,0 +1,29 @@
+/*
+ * journal.h -- wear leveled position journal in the EEPROM
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _journal_h
+#define _journal_h
+
+#include <stdint.h>
+
+/**
+ * \brief Position journal record
+ *
+ * The sequence number increments with every record written, the crc
+ * is the CRC8-CCITT of the first four bytes with initial value 0xff,
+ * which makes erased and cleared records invalid.
+ */
+typedef struct {
+	uint8_t	sequence;
+	uint8_t	position[3];
+	uint8_t	crc;
+} journal_record_t;
+
+#define	JOURNAL_SIZE	64
+
+extern uint32_t	journal_read();
+extern uint8_t	journal_write(uint32_t position);
+
+#endif /* _journal_h */
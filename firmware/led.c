@@ -5,6 +5,8 @@
  */
 #include <led.h>
 #include <avr/io.h>
+#include <timer.h>
+#include <util/atomic.h>
 
 void	led_on() {
 	PORTC &= ~_BV(PORTC7);
@@ -22,8 +24,47 @@ void	led_value(unsigned char v) {
 	}
 }
 
+/*
+ * The power on blink sequence toggles the LED every 100 ms for two
+ * seconds. It is driven by the housekeeping timer, so it does not delay
+ * USB enumeration after a reset.
+ */
+#define	LED_TOGGLE_TICKS	(TIMER_TICKS_PER_SECOND / 10)
+static uint8_t	ledticks = 20 * LED_TOGGLE_TICKS;
+
+/**
+ * \brief Advance the power on blink sequence
+ *
+ * Called from the housekeeping timer interrupt. Once the sequence is
+ * complete, the LED is left to other users. A USB request can preempt
+ * the housekeeping interrupt, so each step of the sequence is done
+ * with interrupts disabled and cannot overwrite an LED state set by
+ * the request.
+ */
+void	led_tick() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (ledticks) {
+			ledticks--;
+			led_value((ledticks / LED_TOGGLE_TICKS) & 1);
+		}
+	}
+}
+
+/**
+ * \brief End the power on blink sequence
+ *
+ * USB enumerates while the sequence is running, so a user of the LED
+ * calls this before setting it, otherwise the sequence would overwrite
+ * it.
+ */
+void	led_done() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ledticks = 0;
+	}
+}
+
 void	led_setup(void) __attribute__ ((constructor));
 void	led_setup(void) {
-	PORTC |= _BV(PORTC7);
+	PORTC &= ~_BV(PORTC7);
 	DDRC |= _BV(DDC7);
 }
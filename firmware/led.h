@@ -9,5 +9,7 @@
 void	led_on();
 void	led_off();
 void	led_value(unsigned char v);
+void	led_tick();
+void	led_done();
 
 #endif /* _led_h */
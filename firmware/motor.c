@@ -8,8 +8,17 @@
 #include <LUFA/Platform/Platform.h>
 #include <LUFA/Drivers/USB/USB.h>
 #include <avr/eeprom.h>
+#include <avr/pgmspace.h>
 #include <led.h>
 #include <eeprom.h>
+#include <timer.h>
+#include <notify.h>
+#include <journal.h>
+#include <settings.h>
+#include <task.h>
+#include <trace.h>
+#include <stats.h>
+#include <util/atomic.h>
 
 #define	MOTOR_ENABLE	PORTC2
 #define MOTOR_MS1	PORTC4
@@ -22,8 +31,6 @@
 
 #define	MS_MASK		(_BV(PORTC4)|_BV(PORTC5)|_BV(PORTC6))
 
-volatile unsigned char	saveneeded = 0;
-
 /**
  * \brief Set the motor stepping mode
  */
@@ -40,26 +47,125 @@ unsigned char	motor_get_step() {
 	return (PORTC & MS_MASK) >> 4;
 }
 
-static volatile uint32_t	current;
-static volatile uint32_t	target;
+/*
+ * Positions never exceed 24 bits, so they are kept in 24 bit variables
+ * to save cycles on the 8 bit core. The motion state seen by the step
+ * interrupt is the direction and the number of full steps still to go.
+ */
+static volatile __uint24	current;
+static __uint24	target;
+static volatile __uint24	remaining;
+static unsigned char	direction;
 static unsigned char	speed = SPEED_SLOW;
-static unsigned char	divisor;
 static unsigned char	microstep;
 static unsigned char	stepsize;
+static unsigned char	stepshift;
+static unsigned char	rampindex;
+static unsigned char	rampmax;
+static unsigned char	shiftpoint;
+static unsigned char	upshift;
+static __uint24	waypoint;
+static volatile unsigned char	running = 0;
+
+/*
+ * Velocity mode: the step interrupt runs at the fixed rate of one tick
+ * every VELOCITY_INTERVAL microseconds and adds the rate to a 16 bit
+ * phase accumulator in every tick. Each carry out of the accumulator is
+ * a sixteenth step pulse, so a rate of 65536 means one pulse per tick.
+ * The rate approaches the commanded rate by at most VELOCITY_ACCEL per
+ * tick, which matches the acceleration of the ramp table, and goes
+ * through zero when the direction changes. A ramp move in a faster
+ * stepping mode first decelerates along the ramp, velocity mode is
+ * pending until it has shifted down to sixteenth steps.
+ */
+#define	VELOCITY_INTERVAL	500
+#define	VELOCITY_ACCEL		480
+static unsigned char	velocitymode = 0;
+static unsigned char	velocitypending = 0;
+static uint16_t	phase;
+static uint16_t	rate;
+static uint16_t	setrate;
+static unsigned char	setdirection;
+
+/**
+ * \brief Number of full steps done in sixteenth steps at the end of a move
+ *
+ * Long fast moves travel in the stepping mode selected by the top speed
+ * and shift down to sixteenth steps when this many full steps are left.
+ */
+#define	APPROACH_STEPS	4
+
+/*
+ * Position and target as seen from outside the step interrupt. Reading
+ * the 24 bit variables while the step interrupt changes them could
+ * return a torn value, and disabling interrupts for every read would
+ * delay step pulses. Instead, every change is published into the
+ * buffer not currently in use, and the generation counter is
+ * incremented after the copy. Readers copy the buffer selected by the
+ * generation and retry if the generation changed while they copied.
+ */
+static volatile motor_status_t	published[2];
+static volatile uint8_t	generation = 0;
+
+/**
+ * \brief Publish position and target, called with interrupts disabled
+ */
+static void	motor_publish() {
+	uint8_t	g = generation + 1;
+	published[g & 1].current = current;
+	published[g & 1].target = target;
+	generation = g;
+}
+
+/**
+ * \brief Get a consistent copy of position and target
+ *
+ * This never disables interrupts, so it can be used from any context.
+ */
+void	motor_status(motor_status_t *status) {
+	uint8_t	g;
+	do {
+		g = generation;
+		status->current = published[g & 1].current;
+		status->target = published[g & 1].target;
+	} while (g != generation);
+}
 
 /**
  * \brief Get the current motor position
  */
 uint32_t	motor_current() {
-	return current;
+	motor_status_t	status;
+	motor_status(&status);
+	return status.current;
 }
 
 uint32_t	motor_speed() {
 	return speed;
 }
 
-volatile uint32_t	lastsaved;
-static volatile uint32_t	timelastchanged = 0;
+/**
+ * \brief Get the microstep phase within the current full step
+ */
+unsigned char	motor_microstep() {
+	return microstep;
+}
+
+/**
+ * \brief Find out whether the motor is still moving
+ */
+unsigned char	motor_moving() {
+	return running;
+}
+
+/*
+ * The position last marked for saving is 32 bits wide and changed by
+ * the housekeeping interrupt, so it is only read with interrupts
+ * disabled.
+ */
+static volatile uint32_t	lastsaved;
+static uint16_t	timelastchanged = 0;
+static uint8_t	idleticks = 0;
 
 /**
  * \brief Get the current target setting
@@ -69,118 +175,698 @@ static volatile uint32_t	timelastchanged = 0;
  * position are different.
  */
 uint32_t	motor_target() {
-	return target;
+	motor_status_t	status;
+	motor_status(&status);
+	return status.target;
+}
+
+/**
+ * \brief Acceleration ramp
+ *
+ * Each entry is the number of timer 1 ticks (microseconds) to wait before
+ * the next step pulse. The table describes a constant acceleration from
+ * 250 to 2000 pulses per second. A move starts at the first entry and
+ * advances by one entry per pulse until it reaches the last entry, at
+ * which it cruises. The ramp is walked backwards as soon as the number
+ * of pulses still needed to reach the target is no larger than the
+ * current ramp index, so that the motor always arrives at the target
+ * at the start rate.
+ */
+static const uint16_t PROGMEM	ramp[] = {
+	4000, 2857, 2341, 2031, 1818, 1661, 1538, 1440, 1358, 1288,
+	1229, 1176, 1130, 1089, 1053, 1019,  989,  961,  936,  912,
+	 890,  870,  850,  833,  816,  800,  785,  771,  758,  745,
+	 733,  721,  710,  700,  690,  680,  671,  662,  653,  645,
+	 637,  630,  622,  615,  608,  602,  595,  589,  583,  577,
+	 571,  566,  561,  555,  550,  545,  541,  536,  531,  527,
+	 523,  518,  514,  510,  506,  502,  500
+};
+#define	RAMP_LENGTH	(sizeof(ramp) / sizeof(ramp[0]))
+
+/**
+ * \brief Find the ramp entry for a step interval
+ *
+ * \return	the index of the fastest ramp entry that is not faster than
+ *		the given interval, or 0 if even the first entry is faster
+ */
+static unsigned char	motor_rampmatch(uint16_t interval) {
+	unsigned char	low = 0;
+	unsigned char	high = RAMP_LENGTH - 1;
+	if (pgm_read_word(&ramp[high]) >= interval) {
+		return high;
+	}
+	while (high - low > 1) {
+		unsigned char	middle = (low + high) / 2;
+		if (pgm_read_word(&ramp[middle]) >= interval) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
 }
 
-#define	DIVISOR	2
+/**
+ * \brief Get the position last marked for saving
+ */
+uint32_t	motor_lastsaved() {
+	uint32_t	value;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		value = lastsaved;
+	}
+	return value;
+}
 
 /**
  * \brief save the current value
+ *
+ * Only the TASK_SAVE task of the main loop may call this, interrupt
+ * handlers post the task instead.
+ *
+ * \return	1 if the position was queued for writing, 0 if the EEPROM
+ *		queue is full and the task has to be retried
+ */
+uint8_t	motor_save() {
+	if (!journal_write(motor_lastsaved())) {
+		return 0;
+	}
+	stats_increment(&stats.journalwrites);
+	return 1;
+}
+
+/**
+ * \brief Select the stepping mode and the matching microstep increment
+ */
+static void	motor_gear(unsigned char step) {
+	motor_set_step(step);
+	switch (step) {
+	case STEP_FULL:		stepsize = 16; stepshift = 4; break;
+	case STEP_HALF:		stepsize =  8; stepshift = 3; break;
+	case STEP_QUARTER:	stepsize =  4; stepshift = 2; break;
+	case STEP_EIGHTH:	stepsize =  2; stepshift = 1; break;
+	default:		stepsize =  1; stepshift = 0; break;
+	}
+}
+
+/**
+ * \brief Compute the number of pulses needed to reach the next stop
+ *
+ * The position only changes when the microstep counter wraps around,
+ * so the microsteps already done in the current full step have to be
+ * taken into account. This is only called near the end of a move, when
+ * the number of steps is at most RAMP_LENGTH, so 16 bits are enough.
  */
-void	motor_save() {
-	GlobalInterruptDisable();
-	eeprom_write_dword(&position, lastsaved);
-	saveneeded = 0;
-	GlobalInterruptEnable();
+static uint16_t	motor_pulses(uint16_t steps) {
+	uint16_t	microsteps = steps << 4;
+	if (direction) {
+		microsteps -= microstep;
+	} else {
+		microsteps -= (16 - microstep) & 0xf;
+	}
+	return microsteps >> stepshift;
 }
 
 /**
- * \brief Handler called from the timer interrupt
+ * \brief Change the direction of motion
  *
- * This function is called from the timer interrupt. If the current position
- * differs from the target, an impuls to the stepper motor driver is generated.
- * The current position in the variable current is then incremented.
+ * The position only changes when the microstep phase wraps around, so
+ * within a full step the position is the full step the motor has left:
+ * the one below when moving up, the one above when moving down. If the
+ * direction changes within a full step, the position has to move to the
+ * other neighbour, so that no count is lost. This must be called with
+ * interrupts disabled or from the step interrupt.
  */
-void	motor_handler() {
-	if (current == target) {
-		if (timelastchanged < 0xffffffff) {
-			timelastchanged++;
+static void	motor_direction(unsigned char dir) {
+	if (dir == direction) {
+		return;
+	}
+	if (microstep) {
+		if (dir) {
+			current--;
+		} else {
+			current++;
 		}
-		if (timelastchanged == 120000) {
-			if (lastsaved != current) {
-				lastsaved = current;
-				saveneeded = 1;
-			}
+	}
+	direction = dir;
+	if (direction) {
+		PORTB |= _BV(MOTOR_DIR);
+	} else {
+		PORTB &= ~_BV(MOTOR_DIR);
+	}
+}
+
+/**
+ * \brief Set up the motion state for a move from current to a position
+ *
+ * Computes direction and number of steps and selects the stepping mode.
+ * Long fast moves travel in the fast stepping mode and shift down for
+ * the final approach, everything else is done in sixteenth steps. A
+ * leg only starts within a full step from standstill, in that case a
+ * fast leg begins in sixteenth steps and shifts up at the next full
+ * step. This must be called with interrupts disabled or from the step
+ * interrupt.
+ */
+static void	motor_leg(__uint24 to) {
+	unsigned char	oldstepsize = stepsize;
+	if (microstep && !direction) {
+		motor_direction((to >= current) ? 1 : 0);
+	} else {
+		motor_direction((to > current) ? 1 : 0);
+	}
+	remaining = (direction) ? to - current : current - to;
+	shiftpoint = 0;
+	upshift = 0;
+	if ((speed == SPEED_FAST) && (remaining > APPROACH_STEPS)) {
+		if (microstep) {
+			motor_gear(STEP_SIXTEENTH);
+			upshift = 1;
+		} else {
+			motor_gear(motor_faststep());
+			shiftpoint = APPROACH_STEPS;
 		}
+	} else {
+		motor_gear(STEP_SIXTEENTH);
+	}
+	// a coarser stepping mode starts at the beginning of the ramp
+	if (stepsize > oldstepsize) {
+		rampindex = 0;
+	}
+}
+
+/**
+ * \brief Number of full steps the motor needs to stop
+ *
+ * These are the full steps needed to get back to the start rate, plus
+ * the final approach in sixteenth steps if the motor is in the fast
+ * mode. This must be called with interrupts disabled.
+ */
+static __uint24	motor_stopsteps() {
+	unsigned char	done = (direction) ? microstep : (16 - microstep) & 0xf;
+	__uint24	stop = (((uint16_t)rampindex << stepshift) + done + 15)
+				>> 4;
+	return stop + shiftpoint;
+}
+
+/**
+ * \brief Change the end of the leg in progress
+ *
+ * The motor keeps its stepping mode, microstep phase and speed. If the
+ * new end point is ahead and far enough away to decelerate, the leg is
+ * simply made longer or shorter. Otherwise the motor decelerates along
+ * the ramp, stops, and the following leg takes it back, so it never
+ * reverses at speed. This must be called with interrupts disabled.
+ */
+static void	motor_retarget(__uint24 to) {
+	__uint24	stop = motor_stopsteps();
+	// distance to the new end point in the direction of motion,
+	// or 0 if it is behind the motor
+	__uint24	ahead = 0;
+	if (direction) {
+		if ((to > current) || ((to == current) && !microstep)) {
+			ahead = to - current;
+		}
+	} else {
+		if ((to < current) || ((to == current) && !microstep)) {
+			ahead = current - to;
+		}
+	}
+	upshift = 0;
+	remaining = (ahead < stop) ? stop : ahead;
+	// a leg that is now too short for the fast mode shifts down, any
+	// microstep phase is valid in sixteenth steps. A stopping leg
+	// only gets there at the start of the ramp, so it stops right
+	// away.
+	if ((shiftpoint) && (remaining <= shiftpoint)) {
+		shiftpoint = 0;
+		motor_gear(STEP_SIXTEENTH);
+		rampindex = 0;
+		if (ahead < stop) {
+			remaining = motor_stopsteps();
+		}
+	}
+	if (ahead < stop) {
 		return;
 	}
-	timelastchanged = 0;
-	// set the direction
-	if (0 == --divisor) {
-		if (speed == SPEED_SLOW) {
-			if (target > current) {
-				microstep = (microstep + 1) % 16;
-				if (0 == microstep) {
-					PORTB |= _BV(MOTOR_DIR);
-					current++;
-				}
-			} else {
-				microstep = (microstep + 15) % 16;
-				if (0 == microstep) {
-					PORTB &= ~_BV(MOTOR_DIR);
-					current--;
-				}
-			}
+	// a slow leg that became fast shifts up at the next full step
+	upshift = (speed == SPEED_FAST) && (stepsize == 1)
+		&& (remaining > APPROACH_STEPS);
+}
+
+/**
+ * \brief Nearest position at which the moving motor can stop
+ *
+ * This must be called with interrupts disabled.
+ */
+static __uint24	motor_stoppoint() {
+	__uint24	stop = motor_stopsteps();
+	if (direction) {
+		return (0xfffffe - current > stop) ? current + stop : 0xfffffe;
+	}
+	return (current - 1 > stop) ? current - stop : 1;
+}
+
+/**
+ * \brief Convert a sixteenth step interval to a velocity mode rate
+ *
+ * A rate of 65536 is one pulse per VELOCITY_INTERVAL ticks, so the
+ * same conversion also turns a rate into an interval. The result is
+ * clamped to 16 bits. This divides, but is only needed when switching
+ * between ramp moves and velocity mode.
+ */
+static uint16_t	motor_rateinterval(uint16_t x) {
+	uint32_t	y = ((uint32_t)65536 * VELOCITY_INTERVAL) / x;
+	return (y > 0xffff) ? 0xffff : y;
+}
+
+/**
+ * \brief Switch to velocity mode, starting at the given rate
+ *
+ * The motor must be in sixteenth steps. This must be called with
+ * interrupts disabled or from the step interrupt.
+ */
+static void	motor_velocitystart(uint16_t r) {
+	velocitymode = 1;
+	velocitypending = 0;
+	remaining = 0;
+	shiftpoint = 0;
+	upshift = 0;
+	speed = SPEED_SLOW;
+	rate = r;
+	phase = 0;
+}
+
+/**
+ * \brief Velocity mode part of the step interrupt
+ */
+static uint16_t	motor_velocity_handler() {
+	// adjust the rate, a direction change needs the rate to be zero
+	if (direction != setdirection) {
+		rate = (rate > VELOCITY_ACCEL) ? rate - VELOCITY_ACCEL : 0;
+		if (0 == rate) {
+			motor_direction(setdirection);
+			motor_publish();
+		}
+	} else if (rate < setrate) {
+		rate = (setrate - rate > VELOCITY_ACCEL)
+			? rate + VELOCITY_ACCEL : setrate;
+	} else if (rate > setrate) {
+		rate = (rate - setrate > VELOCITY_ACCEL)
+			? rate - VELOCITY_ACCEL : setrate;
+	}
+	if ((0 == rate) && (0 == setrate)) {
+		goto stop;
+	}
+	// advance the phase, a carry is a step pulse
+	uint16_t	oldphase = phase;
+	phase += rate;
+	if (phase >= oldphase) {
+		return VELOCITY_INTERVAL;
+	}
+	PORTB |= _BV(MOTOR_STEP);
+	PORTB &= ~_BV(MOTOR_STEP);
+	stats.steps[stepshift]++;
+	if (direction) {
+		microstep = (microstep + 1) & 0xf;
+	} else {
+		microstep = (microstep - 1) & 0xf;
+	}
+	if (0 == microstep) {
+		if (direction) {
+			current++;
 		} else {
-			if (target > current) {
-				microstep = (microstep + stepsize) % 16;
-				if (0 == microstep) {
-					PORTB |= _BV(MOTOR_DIR);
-					current++;
-				}
-			} else {
-				microstep = (microstep + (16 - stepsize)) % 16;
-				if (0 == microstep) {
-					PORTB &= ~_BV(MOTOR_DIR);
-					current--;
-				}
+			current--;
+		}
+		motor_publish();
+		// the end of the range stops the motor without deceleration
+		if (current == target) {
+			goto stop;
+		}
+	}
+	return VELOCITY_INTERVAL;
+stop:
+	velocitymode = 0;
+	target = current;
+	motor_publish();
+	running = 0;
+	notify_post(NOTIFY_MOVE);
+	return 0;
+}
+
+/**
+ * \brief Move part of the step interrupt
+ *
+ * If there are steps remaining, an impuls to the stepper motor driver
+ * is generated. Whenever the microstep counter completes a full step,
+ * the current position is updated and the remaining step counter
+ * decremented. The return value is the number of timer ticks until the
+ * next pulse, taken from the acceleration ramp, or 0 if the target has
+ * been reached and the step timer can be stopped.
+ */
+static uint16_t	motor_move_handler() {
+	if (0 == remaining) {
+		// a move with backlash compensation continues with the
+		// final approach after the overshoot, a retargeted move
+		// continues after stopping
+		if (current == target) {
+			running = 0;
+			notify_post(NOTIFY_MOVE);
+			return 0;
+		}
+		if (current == waypoint) {
+			waypoint = target;
+		}
+		motor_leg(waypoint);
+		motor_publish();
+	}
+	// send a pulse, the direction was set by motor_moveto
+	PORTB |= _BV(MOTOR_STEP);
+	PORTB &= ~_BV(MOTOR_STEP);
+	stats.steps[stepshift]++;
+	if (direction) {
+		microstep = (microstep + stepsize) & 0xf;
+	} else {
+		microstep = (microstep - stepsize) & 0xf;
+	}
+	if (0 == microstep) {
+		if (direction) {
+			current++;
+		} else {
+			current--;
+		}
+		remaining--;
+		motor_publish();
+		// shift down to sixteenth steps for the final approach,
+		// or up to the fast mode if a move became fast, the
+		// microstep phase is 0 here, so it is valid in any mode
+		if ((shiftpoint) && (remaining == shiftpoint)) {
+			shiftpoint = 0;
+			motor_gear(STEP_SIXTEENTH);
+			rampindex = 0;
+		}
+		if ((upshift) && (remaining > APPROACH_STEPS)) {
+			// continue at the same speed in the fast mode, or at
+			// its start rate if that is faster, and let the ramp
+			// limit grow with the index
+			uint16_t	interval
+					= pgm_read_word(&ramp[rampindex]);
+			upshift = 0;
+			motor_gear(motor_faststep());
+			shiftpoint = APPROACH_STEPS;
+			rampindex = motor_rampmatch(interval << stepshift);
+			if (rampmax < rampindex) {
+				rampmax = rampindex;
 			}
 		}
-		// send a pulse
-		PORTB |= _BV(MOTOR_STEP);
-		PORTB &= ~_BV(MOTOR_STEP);
-		// set the speed divisor to the appropriate value
-		divisor = DIVISOR;
 	}
+	// accelerate, or decelerate if the remaining pulses are just
+	// enough to get back to the start rate at the shift point or
+	// at the target. While an upshift is pending, the limit applies
+	// to the fast mode and does not slow the motor down.
+	__uint24	steps = (remaining > shiftpoint)
+				? remaining - shiftpoint : 0;
+	if ((0 == steps) || ((steps <= RAMP_LENGTH)
+		&& (motor_pulses(steps) <= rampindex))) {
+		if (rampindex > 0) {
+			rampindex--;
+		}
+	} else {
+		if (rampindex < rampmax) {
+			rampindex++;
+		} else if ((rampindex > rampmax) && (!upshift)) {
+			rampindex--;
+		}
+	}
+	return pgm_read_word(&ramp[rampindex]);
 }
 
-void	motor_moveto(uint32_t position, unsigned char _speed) {
-	GlobalInterruptDisable();
-	target = position;
-#if 0
-	// if switching to slow speed, reset microstep counter
-	if ((speed != _speed) && (_speed == SPEED_SLOW)) {
-		microstep = 0;
+/**
+ * \brief Handler called from the step timer interrupt
+ *
+ * This function is called from the timer 1 compare interrupt, it returns
+ * the number of timer ticks until the next call, or 0 if the step timer
+ * can be stopped. While tracing is enabled, the new motor state is
+ * handed to the trace buffer.
+ */
+uint16_t	motor_handler() {
+	uint16_t	interval = (velocitymode)
+				? motor_velocity_handler() : motor_move_handler();
+	// a ramp move that was waiting for the sixteenth steps hands over
+	// to velocity mode at its current speed
+	if ((velocitypending) && (0 == stepshift) && (interval)) {
+		motor_velocitystart(motor_rateinterval(interval));
+		interval = VELOCITY_INTERVAL;
 	}
-#else
-	// always reset the microstep counter
-	microstep = 0;
-#endif
+	if (trace_enabled) {
+		trace_step(current, microstep,
+			((direction) ? TRACE_UP : 0) | stepshift, interval);
+	}
+	return interval;
+}
+
+/**
+ * \brief Handler called from the housekeeping timer interrupt
+ *
+ * Once the motor has been idle for the configured save delay, the
+ * position is marked for saving to the EEPROM.
+ */
+void	motor_tick() {
+	if (running) {
+		idleticks = 0;
+		timelastchanged = 0;
+		return;
+	}
+	if (++idleticks < TIMER_TICKS_PER_SECOND) {
+		return;
+	}
+	idleticks = 0;
+	if (timelastchanged < 0xffff) {
+		timelastchanged++;
+	}
+	if (timelastchanged == motor_get_savedelay()) {
+		motor_flush();
+	}
+}
+
+/**
+ * \brief Mark the current position for saving
+ *
+ * The main loop writes the position to the EEPROM as soon as possible.
+ * This is called from interrupt handlers, e.g. when the USB bus is
+ * suspended or disconnected.
+ */
+void	motor_flush() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (lastsaved != current) {
+			lastsaved = current;
+			task_post(TASK_SAVE);
+		}
+	}
+}
+
+/**
+ * \brief Move to a new position
+ *
+ * If backlash compensation is configured and the move goes against the
+ * preferred approach direction, the motor first overshoots the target
+ * by the backlash amount and then approaches it from the preferred side.
+ * The target reported to the host is always the final position. This
+ * must be called with interrupts disabled.
+ */
+static void	motor_go(__uint24 position, unsigned char _speed) {
+	// a move ends velocity mode, the ramp continues at the ramp entry
+	// matching the current rate
+	if (velocitymode) {
+		velocitymode = 0;
+		rampindex = (rate)
+			? motor_rampmatch(motor_rateinterval(rate)) : 0;
+		shiftpoint = 0;
+	}
+	velocitypending = 0;
+	target = position;
 	speed = _speed;
-	switch (speed) {
-	case SPEED_FAST: {
-			unsigned char	s = motor_faststep();
-			motor_set_step(s);
-			switch (s) {
-				case 0:	stepsize = 16; break;
-				case 1:	stepsize =  8; break;
-				case 2:	stepsize =  4; break;
-				case 3:	stepsize =  2; break;
+	rampmax = RAMP_LENGTH - 1;
+	// find the overshoot point if the backlash has to be taken up
+	__uint24	to = target;
+	uint16_t	backlashsteps = settings.backlash;
+	if (backlashsteps) {
+		if ((settings.backlashdir == BACKLASH_UP) && (target < current)) {
+			to = (target > backlashsteps)
+				? target - backlashsteps : 1;
+		}
+		if ((settings.backlashdir == BACKLASH_DOWN)
+			&& (target > current)) {
+			to = (0xfffffe - target > backlashsteps)
+				? target + backlashsteps : 0xfffffe;
+		}
+	}
+	waypoint = to;
+	// a moving motor blends into the new move, a motor at standstill
+	// needs the step timer to be started
+	if (running) {
+		motor_retarget(to);
+	} else {
+		motor_leg(to);
+		if ((current != target) || (microstep)) {
+			running = 1;
+			rampindex = 0;
+			timer_schedule(pgm_read_word(&ramp[0]));
+		}
+	}
+	motor_publish();
+}
+
+void	motor_moveto(uint32_t position, unsigned char _speed) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		motor_go(position, _speed);
+	}
+}
+
+/**
+ * \brief Start a move with a limited top rate
+ *
+ * Like motor_moveto, but the motor does not accelerate beyond the
+ * given ramp index until the limit is raised with motor_limit.
+ */
+void	motor_jog(uint32_t position, unsigned char _speed, uint8_t limit) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		motor_go(position, _speed);
+		motor_limit(limit);
+	}
+}
+
+/**
+ * \brief Change the ramp index limit of the current move
+ *
+ * If the motor is faster than the new limit, it decelerates along the
+ * ramp. The limit is clamped to the end of the ramp. A limit set while
+ * a slow leg waits for the upshift to the fast mode applies to the fast
+ * mode, and the upshift raises it to the ramp index that continues at
+ * the same speed.
+ *
+ * \return	the new limit
+ */
+uint8_t	motor_limit(uint8_t limit) {
+	if (limit > RAMP_LENGTH - 1) {
+		limit = RAMP_LENGTH - 1;
+	}
+	rampmax = limit;
+	return limit;
+}
+
+/**
+ * \brief Raise the ramp index limit of the current move by one entry
+ *
+ * \return	1 if the limit was raised, 0 if it already is at the end
+ *		of the ramp
+ */
+uint8_t	motor_raiselimit() {
+	uint8_t	raised = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (rampmax < RAMP_LENGTH - 1) {
+			rampmax++;
+			raised = 1;
+		}
+	}
+	return raised;
+}
+
+/**
+ * \brief Move at a constant velocity
+ *
+ * The motor moves in sixteenth steps at the given velocity until it is
+ * stopped, another move is started, or it reaches the end of the range.
+ * A ramp move in progress hands over at its current speed, after
+ * decelerating to sixteenth steps if necessary. A velocity of 0
+ * decelerates and stops the motor if it is in velocity mode. The
+ * target reported during a velocity move is the end of the range in
+ * the direction of the motion.
+ *
+ * \param velocity	velocity in 1/1000 full steps per second, the
+ *			magnitude is limited to VELOCITY_MAX
+ */
+void	motor_velocity(int32_t velocity) {
+	unsigned char	dir = (velocity >= 0) ? 1 : 0;
+	uint32_t	v = (dir) ? velocity : -velocity;
+	if (v > VELOCITY_MAX) {
+		v = VELOCITY_MAX;
+	}
+	// 1/1000 full steps per second to the phase increment per tick:
+	// v * 16 / 1000 * 65536 * VELOCITY_INTERVAL / 1000000, which is
+	// v * 8192 / 15625 for VELOCITY_INTERVAL = 500
+	uint32_t	r = (v * 8192) / 15625;
+	if (r > 0xffff) {
+		r = 0xffff;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ((!velocitymode) && (!velocitypending) && (0 == r)) {
+			return;
+		}
+		__uint24	end = (dir) ? 0xfffffe : 1;
+		if ((!running) && (current == end)) {
+			return;
+		}
+		setrate = r;
+		setdirection = dir;
+		target = end;
+		motor_publish();
+		if ((velocitymode) || (velocitypending)) {
+			return;
+		}
+		// a ramp move keeps its speed: in sixteenth steps, velocity
+		// mode takes over right away, a faster stepping mode first
+		// decelerates along the ramp and shifts down
+		if (running) {
+			if (stepshift) {
+				motor_retarget(motor_stoppoint());
 			}
+			if (stepshift) {
+				velocitypending = 1;
+			} else {
+				motor_velocitystart(motor_rateinterval(
+					pgm_read_word(&ramp[rampindex])));
+			}
+			return;
+		}
+		// from standstill, the rate starts at zero
+		motor_velocitystart(0);
+		motor_gear(STEP_SIXTEENTH);
+		motor_direction(dir);
+		motor_publish();
+		running = 1;
+		timer_schedule(VELOCITY_INTERVAL);
+	}
+}
+
+/**
+ * \brief Move relative to the current target
+ *
+ * The new target is computed from the current target with interrupts
+ * disabled, so that it cannot race with a move in progress. The result
+ * is clamped to the range accepted by the SET request.
+ */
+void	motor_move(int32_t delta, unsigned char _speed) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		int32_t	position = (int32_t)target + delta;
+		if (position < 1) {
+			position = 1;
+		}
+		if (position > 0xfffffe) {
+			position = 0xfffffe;
 		}
-		break;
-	case SPEED_SLOW:
-		motor_set_step(STEP_SIXTEENTH);
-		break;
+		motor_go(position, _speed);
 	}
-	GlobalInterruptEnable();
 }
 
 void	motor_position(uint32_t position) {
-	GlobalInterruptDisable();
-	target = position;
-	current = position;
-	GlobalInterruptEnable();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		velocitymode = 0;
+		velocitypending = 0;
+		target = position;
+		current = position;
+		lastsaved = position;
+		remaining = 0;
+		motor_publish();
+	}
 }
 
 /**
@@ -190,11 +876,34 @@ void	motor_position(uint32_t position) {
  * which implies that there is no need to step any further.
  */
 void	motor_stop() {
-	GlobalInterruptDisable();
-	if (current != target) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		velocitymode = 0;
+		velocitypending = 0;
 		target = current;
+		remaining = 0;
+		motor_publish();
+		notify_post(NOTIFY_STOP);
+	}
+}
+
+/**
+ * \brief Stop the motor along the deceleration ramp
+ *
+ * Unlike motor_stop, this does not end the move at speed. The target
+ * becomes the nearest position at which the motor can stop, and the
+ * move is retargeted to it like any other new target, so backlash
+ * compensation applies. In velocity mode, the motor decelerates to
+ * zero velocity.
+ */
+void	motor_halt() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ((velocitymode) || (velocitypending)) {
+			setrate = 0;
+		} else if (running) {
+			motor_go(motor_stoppoint(), speed);
+		}
+		notify_post(NOTIFY_STOP);
 	}
-	GlobalInterruptEnable();
 }
 
 void	motor_setup(void) __attribute__ ((constructor));
@@ -214,42 +923,33 @@ void	motor_setup(void) {
 	DDRC |= 0x74;
 	DDRB |= 0xf0;
 	// read the current value from the EEPROM
-	current = eeprom_read_dword(&position);
+	current = journal_read();
 	lastsaved = current;
 	// set the target also to the current, so we don't move anything
 	target = current;
+	remaining = 0;
 	microstep = 0;
+	motor_publish();
 }
 
-static uint8_t	lasttopspeed = 0xff;
-
 /**
- * \brief Get the top speed byte (0 for fastest, 4 for slowest)
+ * \brief Get the top speed byte (0 for fastest, 3 for slowest)
  *
  * \return	the top speed byte
  */
 uint8_t	motor_get_topspeed() {
-	if (lasttopspeed == 0xff) {
-		lasttopspeed = eeprom_read_byte(&topspeed);
-		if (lasttopspeed > 3) {
-			lasttopspeed = 0;
-			eeprom_write_byte(&topspeed, lasttopspeed);
-		}
-	}
-	return lasttopspeed;
+	return settings.topspeed;
 }
 
 /**
- * \brief Set the top speed in the EEPROM
+ * \brief Set the top speed in the configuration block
  *
  * \param settopspeed	the top speed value to remember
  */
 void	motor_set_topspeed(uint8_t settopspeed) {
-	if (settopspeed > 3) {
-		return;
-	}
-	eeprom_write_byte(&topspeed, settopspeed);
-	lasttopspeed = settopspeed;
+	settings_t	s = settings;
+	s.topspeed = settopspeed;
+	settings_update(&s);
 }
 
 /**
@@ -258,7 +958,7 @@ void	motor_set_topspeed(uint8_t settopspeed) {
  * \return	get the step configuration byte for the stepper driver
  */
 uint8_t	motor_faststep() {
-	switch (motor_get_topspeed()) {
+	switch (settings.topspeed) {
 	case 0:	return STEP_FULL;
 	case 1:	return STEP_HALF;
 	case 2:	return STEP_QUARTER;
@@ -267,3 +967,59 @@ uint8_t	motor_faststep() {
 	/* by default, give the fastest speed (for compatibility) 	*/
 	return STEP_FULL;
 }
+
+/**
+ * \brief Get the backlash compensation amount
+ */
+uint16_t	motor_get_backlash() {
+	return settings.backlash;
+}
+
+/**
+ * \brief Get the preferred direction of the final approach
+ */
+uint8_t	motor_get_backlashdir() {
+	return settings.backlashdir;
+}
+
+/**
+ * \brief Set the backlash compensation in the configuration block
+ *
+ * \param steps		the number of steps to overshoot, 0 disables
+ *			backlash compensation
+ * \param dir		BACKLASH_UP or BACKLASH_DOWN, the direction of
+ *			the final approach
+ */
+void	motor_set_backlash(uint16_t steps, uint8_t dir) {
+	settings_t	s = settings;
+	s.backlash = steps;
+	s.backlashdir = dir;
+	settings_update(&s);
+}
+
+/**
+ * \brief Get the number of seconds the motor has to be idle before the
+ *        position is saved
+ *
+ * The housekeeping interrupt reads this while a SETTINGS request may
+ * be replacing the configuration block, so it is read with interrupts
+ * disabled.
+ */
+uint16_t	motor_get_savedelay() {
+	uint16_t	seconds;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		seconds = settings.savedelay;
+	}
+	return seconds;
+}
+
+/**
+ * \brief Set the save delay in the configuration block
+ *
+ * \param seconds	idle time before the position is saved, 1 to 65534
+ */
+void	motor_set_savedelay(uint16_t seconds) {
+	settings_t	s = settings;
+	s.savedelay = seconds;
+	settings_update(&s);
+}
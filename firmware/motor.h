@@ -17,23 +17,58 @@
 #define STEP_EIGHTH	0x3
 #define STEP_SIXTEENTH	0x7
 
+#define SAVEDELAY_DEFAULT	10
+
+/* fastest velocity mode speed in 1/1000 full steps per second */
+#define VELOCITY_MAX	125000
+
+#define BACKLASH_DOWN	0
+#define BACKLASH_UP	1
+
+/**
+ * \brief Consistent snapshot of position and target
+ */
+typedef struct {
+	__uint24	current;
+	__uint24	target;
+} motor_status_t;
+
+extern void	motor_status(motor_status_t *status);
+
 extern void	motor_set_step(unsigned char step);
-extern unsigned char	motor_get_stepping();
+extern unsigned char	motor_get_step();
+extern unsigned char	motor_microstep();
 
 extern void	motor_moveto(uint32_t position, unsigned char speed);
+extern void	motor_move(int32_t delta, unsigned char speed);
+extern void	motor_jog(uint32_t position, unsigned char speed, uint8_t limit);
+extern uint8_t	motor_limit(uint8_t limit);
+extern uint8_t	motor_raiselimit();
+extern void	motor_velocity(int32_t velocity);
 extern void	motor_position(uint32_t position);
 extern uint32_t	motor_current();
 extern void	motor_stop();
+extern void	motor_halt();
 extern uint32_t	motor_target();
 extern uint32_t	motor_speed();
+extern unsigned char	motor_moving();
 
 extern void	motor_set_topspeed(uint8_t settopspeed);
 extern uint8_t	motor_get_topspeed();
 extern uint8_t	motor_faststep();
 
-extern volatile uint32_t	lastsaved;
-extern volatile unsigned char	saveneeded;
+extern void	motor_set_backlash(uint16_t steps, uint8_t dir);
+extern uint16_t	motor_get_backlash();
+extern uint8_t	motor_get_backlashdir();
+
+extern uint32_t	motor_lastsaved();
+extern uint8_t	motor_save();
+extern void	motor_flush();
+
+extern uint16_t	motor_get_savedelay();
+extern void	motor_set_savedelay(uint16_t seconds);
 
-extern void	motor_save();
+extern uint16_t	motor_handler();
+extern void	motor_tick();
 
 #endif /* _motor_h */
@@ -0,0 +1,71 @@
+/*
+ * notify.c -- event records sent to the host on the interrupt endpoint
+ *
+ * Interrupt handlers post events by setting a bit in the pending mask,
+ * the main loop turns them into records as soon as the endpoint is
+ * ready to accept data.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <notify.h>
+#include <descriptor.h>
+#include <motor.h>
+#include <receiver.h>
+#include <program.h>
+#include <task.h>
+#include <util/atomic.h>
+
+volatile uint8_t	notify_pending = 0;
+
+/**
+ * \brief Post an event
+ *
+ * This may be called from any context. The housekeeping interrupt runs
+ * with interrupts enabled, so the step interrupt can post an event while
+ * the receiver handler is updating the mask.
+ */
+void	notify_post(uint8_t type) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		notify_pending |= type;
+	}
+	task_post(TASK_NOTIFY);
+}
+
+/**
+ * \brief Send the next pending event record, called from the main loop
+ *
+ * \return	1 if no more events are pending, 0 if the task has to be
+ *		retried
+ */
+uint8_t	notify_task() {
+	if (!notify_pending) {
+		return 1;
+	}
+	if (USB_DeviceState != DEVICE_STATE_Configured) {
+		return 0;
+	}
+	Endpoint_SelectEndpoint(EVENT_EPADDR);
+	if (!Endpoint_IsINReady()) {
+		return 0;
+	}
+	// find the lowest pending event and remove it from the mask
+	uint8_t	type = 1;
+	while (!(notify_pending & type)) {
+		type <<= 1;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		notify_pending &= ~type;
+	}
+	// build the record
+	uint32_t	position = motor_current();
+	uint8_t	record[NOTIFY_RECORD_SIZE];
+	record[0] = type;
+	record[1] = recv_get();
+	record[2] = position & 0xff;
+	record[3] = (position >> 8) & 0xff;
+	record[4] = (position >> 16) & 0xff;
+	record[5] = program_current();
+	Endpoint_Write_Stream_LE(record, sizeof(record), NULL);
+	Endpoint_ClearIN();
+	return (notify_pending) ? 0 : 1;
+}
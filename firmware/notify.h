@@ -0,0 +1,30 @@
+/*
+ * notify.h -- event records sent to the host on the interrupt endpoint
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _notify_h
+#define _notify_h
+
+#include <stdint.h>
+
+/**
+ * \brief Event types
+ *
+ * Each event type is a bit in the pending mask, events of the same type
+ * that happen before the host has picked up the record are coalesced.
+ * The record sent to the host consists of the type, the receiver state,
+ * the 24 bit current position and the active program segment.
+ */
+#define	NOTIFY_MOVE	0x01
+#define	NOTIFY_STOP	0x02
+#define	NOTIFY_BUTTONS	0x04
+
+#define	NOTIFY_RECORD_SIZE	6
+
+extern volatile uint8_t	notify_pending;
+
+extern void	notify_post(uint8_t type);
+extern uint8_t	notify_task();
+
+#endif /* _notify_h */
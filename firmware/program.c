@@ -0,0 +1,104 @@
+/*
+ * program.c -- motion programs executed by the focuser
+ *
+ * A motion program is a short list of segments, each consisting of a
+ * target position, a speed and a dwell time. The housekeeping timer
+ * interrupt starts the next segment as soon as the motor has reached
+ * the target of the current segment and the dwell time has elapsed.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <program.h>
+#include <motor.h>
+#include <timer.h>
+#include <util/atomic.h>
+
+program_segment_t	program[PROGRAM_SIZE];
+static volatile uint8_t	programlength = 0;
+static volatile uint8_t	programindex = 0;
+static uint16_t	dwellticks = 0;
+
+#define	MS_PER_TICK	(1000 / TIMER_TICKS_PER_SECOND)
+
+/**
+ * \brief Start the segment with the current index
+ */
+static void	program_start() {
+	program_segment_t	*segment = &program[programindex];
+	uint32_t	position = segment->position[0]
+				| ((uint32_t)segment->position[1] << 8)
+				| ((uint32_t)segment->position[2] << 16);
+	dwellticks = (segment->dwell + MS_PER_TICK - 1) / MS_PER_TICK;
+	motor_moveto(position, (segment->speed) ? SPEED_FAST : SPEED_SLOW);
+}
+
+/**
+ * \brief Start a program of length segments
+ *
+ * The segments must already have been copied into the program array.
+ * Programs with positions outside the valid range are rejected.
+ *
+ * \return	1 if the program was started, 0 if it was rejected
+ */
+uint8_t	program_load(uint8_t length) {
+	if ((length == 0) || (length > PROGRAM_SIZE)) {
+		return 0;
+	}
+	for (uint8_t i = 0; i < length; i++) {
+		uint8_t	*p = program[i].position;
+		if ((p[2] == 0) && (p[1] == 0) && (p[0] == 0)) {
+			return 0;
+		}
+		if ((p[2] == 0xff) && (p[1] == 0xff) && (p[0] == 0xff)) {
+			return 0;
+		}
+	}
+	// the first segment is started before the program length is set,
+	// so that the housekeeping interrupt cannot advance the program
+	// before the first move has begun
+	programlength = 0;
+	programindex = 0;
+	program_start();
+	programlength = length;
+	return 1;
+}
+
+/**
+ * \brief Cancel a running program
+ *
+ * The current move is not stopped, but no further segments are started.
+ */
+void	program_cancel() {
+	programlength = 0;
+}
+
+/**
+ * \brief Index of the active segment, or -1 if no program is running
+ */
+int8_t	program_current() {
+	return (programindex < programlength) ? programindex : -1;
+}
+
+/**
+ * \brief Handler called from the housekeeping timer interrupt
+ *
+ * The housekeeping interrupt can be interrupted by a PROGRAM request,
+ * so the program state is only touched with interrupts disabled.
+ */
+void	program_handler() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (programindex >= programlength) {
+			return;
+		}
+		if (motor_moving()) {
+			return;
+		}
+		if (dwellticks) {
+			dwellticks--;
+			return;
+		}
+		if (++programindex < programlength) {
+			program_start();
+		}
+	}
+}
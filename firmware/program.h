@@ -0,0 +1,32 @@
+/*
+ * program.h -- motion programs executed by the focuser
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _program_h
+#define _program_h
+
+#include <stdint.h>
+
+/**
+ * \brief One segment of a motion program
+ *
+ * This is also the layout of the data stage of the PROGRAM request,
+ * the position is a 24 bit little endian value.
+ */
+typedef struct {
+	uint8_t		position[3];
+	uint8_t		speed;
+	uint16_t	dwell;		// milliseconds to wait after the move
+} program_segment_t;
+
+#define	PROGRAM_SIZE	8
+
+extern uint8_t	program_load(uint8_t length);
+extern void	program_cancel();
+extern int8_t	program_current();
+extern void	program_handler();
+
+extern program_segment_t	program[PROGRAM_SIZE];
+
+#endif /* _program_h */
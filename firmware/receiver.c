@@ -5,12 +5,28 @@
  */
 #include <receiver.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <led.h>
 #include <motor.h>
+#include <timer.h>
+#include <program.h>
+#include <notify.h>
+#include <settings.h>
 
 static unsigned char	last = 0;
 static unsigned char	locked = 0;
 
+/*
+ * The receiver outputs are only sampled when they have been stable for
+ * RECV_DEBOUNCE_TICKS housekeeping ticks after the last pin change.
+ * Short glitches on the data lines of the RF module thus never reach
+ * the motor.
+ */
+#define	RECV_DEBOUNCE_TICKS	(TIMER_TICKS_PER_SECOND / 20)
+static volatile uint8_t	debounceticks = RECV_DEBOUNCE_TICKS;
+static unsigned char	stable = 0;
+
 /**
  * \brief get the current button state output by the receiver
  */
@@ -23,8 +39,33 @@ void	recv_setup(void) {
 	// enable the pull up
 	PORTD |= _BV(PORTD7)|_BV(PORT6)|_BV(PORT5)|_BV(PORT4)|_BV(PORT3);
 	DDRD &= ~(_BV(DDD7)|_BV(DDD6)|_BV(DDD5)|_BV(DDD4)|_BV(DDD3));
+	// interrupt on any change of the receiver outputs: PD3 is INT3,
+	// PD4 is INT5, PD6 is INT6, PD7 is INT7 and PD5 is only available
+	// as pin change interrupt PCINT12
+	EICRA = (EICRA & ~(0x3 << ISC30)) | (0x1 << ISC30);
+	EICRB = (EICRB & ~((0x3 << ISC50) | (0x3 << ISC60) | (0x3 << ISC70)))
+		| (0x1 << ISC50) | (0x1 << ISC60) | (0x1 << ISC70);
+	EIFR = _BV(INTF3) | _BV(INTF5) | _BV(INTF6) | _BV(INTF7);
+	EIMSK |= _BV(INT3) | _BV(INT5) | _BV(INT6) | _BV(INT7);
+	PCMSK1 |= _BV(PCINT12);
+	PCIFR = _BV(PCIF1);
+	PCICR |= _BV(PCIE1);
 }
 
+/**
+ * \brief Receiver pin change interrupt
+ *
+ * Restarts the debounce timer, the pins are read by the housekeeping
+ * interrupt once they have settled.
+ */
+ISR(INT3_vect) {
+	debounceticks = RECV_DEBOUNCE_TICKS;
+}
+ISR(INT5_vect, ISR_ALIASOF(INT3_vect));
+ISR(INT6_vect, ISR_ALIASOF(INT3_vect));
+ISR(INT7_vect, ISR_ALIASOF(INT3_vect));
+ISR(PCINT1_vect, ISR_ALIASOF(INT3_vect));
+
 /**
  * \brief Lock the device
  *
@@ -35,6 +76,7 @@ void	recv_setup(void) {
  */
 void	recv_lock() {
 	locked = 1;
+	led_done();
 	led_on();
 }
 
@@ -47,32 +89,118 @@ void	recv_lock() {
  */
 void	recv_unlock() {
 	locked = 0;
+	led_done();
 	led_off();
 }
 
+/*
+ * Jog state: a short press of A or B nudges the focuser by one step.
+ * If the button is held for the jog delay, the focuser starts moving
+ * in sixteenth steps and speeds up by one ramp entry every jog rate
+ * ticks. At the top of the ramp it shifts to the fast stepping mode at
+ * the same speed and speeds up again. Releasing the button decelerates
+ * along the ramp. Zero jog parameters select the defaults.
+ */
+static int8_t	jogdirection = 0;
+static uint16_t	jogticks = 0;
+static uint8_t	jogspeed = SPEED_SLOW;
+
+static uint8_t	recv_jogdelay() {
+	return (settings.jogdelay) ? settings.jogdelay : JOGDELAY_DEFAULT;
+}
+
+static uint8_t	recv_jograte() {
+	return (settings.jograte) ? settings.jograte : JOGRATE_DEFAULT;
+}
+
+/**
+ * \brief Start jogging in a direction with a single step nudge
+ *
+ * Nudges add up, so a nudge that follows an unfinished nudge starts from
+ * the target of the previous one. Any other move is cut short, and the
+ * nudge starts from the current position.
+ */
+static void	recv_jogstart(int8_t direction, uint8_t nudging) {
+	jogdirection = direction;
+	jogticks = 0;
+	uint32_t	position = (nudging) ? motor_target() : motor_current();
+	position += direction;
+	if ((position < 1) || (position > 0xfffffe)) {
+		return;
+	}
+	motor_moveto(position, SPEED_SLOW);
+}
+
+/**
+ * \brief Advance the jog speed, called every tick while A or B is held
+ */
+static void	recv_jog() {
+	uint8_t	delay = recv_jogdelay();
+	if (jogticks < 0xffff) {
+		jogticks++;
+	}
+	if (jogticks < delay) {
+		return;
+	}
+	uint32_t	end = (jogdirection > 0) ? 0xffffff : 0x000001;
+	if (jogticks == delay) {
+		jogspeed = SPEED_SLOW;
+		motor_jog(end, jogspeed, 0);
+		return;
+	}
+	if ((jogticks - delay) % recv_jograte()) {
+		return;
+	}
+	if (motor_raiselimit()) {
+		return;
+	}
+	// the motor shifts up at the next full step, and the limit is
+	// raised to the ramp entry that continues at the same speed
+	if (jogspeed == SPEED_SLOW) {
+		jogspeed = SPEED_FAST;
+		motor_jog(end, jogspeed, 0);
+	}
+}
+
 // to unlock, press buttons C and D for at least two seconds, i.e. for
-// at least 2000 counts of the unlock-counter
+// at least UNLOCK_TICKS counts of the unlock-counter
+#define	UNLOCK_TICKS	(2 * TIMER_TICKS_PER_SECOND)
 static unsigned short	unlockcounter = 0;
 
 /**
  * \brief handler to be called during the timer interrupt
  *
- * The handler checks the state of the buttons and changes the behaviour
- * of the focuser accordingly
+ * The handler checks the debounced state of the buttons and changes the
+ * behaviour of the focuser accordingly. If no pin has changed and no
+ * unlock timing is in progress, it returns right away.
  */
 void	recv_handler() {
-	unsigned char	now = recv_get();
+	// wait for the pins to settle after a change
+	uint8_t	settled = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (debounceticks) {
+			settled = (0 == --debounceticks);
+		}
+	}
+	if (settled) {
+		stable = PIND >> 3;
+	} else if (!unlockcounter && (stable == last) && !jogdirection
+		&& !(locked && (stable & RECV_C) && (stable & RECV_D))) {
+		return;
+	}
+	unsigned char	now = stable;
 	// locking/unlocking
 	if (locked) {
 		if ((now & RECV_C) && (now & RECV_D)) {
 			unlockcounter++;
 		}
-		if (unlockcounter > 2000) {
+		if (unlockcounter > UNLOCK_TICKS) {
 			recv_unlock();
-			unlockcounter = 2000;
+			unlockcounter = UNLOCK_TICKS;
 		}
 		// if the buttons are locked, we don't need to look at them
 		last = 0;
+		jogdirection = 0;
 		return;
 	}
 
@@ -83,10 +211,16 @@ void	recv_handler() {
 		return;
 	}
 
-	// if the state has not changed, nothing needs to be done
+	// if the state has not changed, only the jog speed changes
 	if (now == last) {
+		if (jogdirection) {
+			recv_jog();
+		}
 		return;
 	}
+	notify_post(NOTIFY_BUTTONS);
+	uint8_t	nudging = (jogdirection) && (jogticks < recv_jogdelay());
+	jogdirection = 0;
 
 	// handle all possible combinations 
 	unsigned char	speed = ((now & RECV_C) || (now & RECV_D))
@@ -98,17 +232,29 @@ void	recv_handler() {
 	if (now & RECV_D) {
 		direction |= RECV_B;
 	}
+	program_cancel();
 	switch (direction) {
 	case RECV_A:
-		motor_moveto(0xffffff, speed);
+		if (speed == SPEED_FAST) {
+			motor_moveto(0xffffff, speed);
+		} else {
+			recv_jogstart(1, nudging);
+		}
 		break;
 	case RECV_B:
-		motor_moveto(0x000001, speed);
+		if (speed == SPEED_FAST) {
+			motor_moveto(0x000001, speed);
+		} else {
+			recv_jogstart(-1, nudging);
+		}
 		break;
 	default:
-		motor_stop();
+		// the single step nudge of a short press is completed, a
+		// move decelerates so that no steps are lost
+		if (!nudging) {
+			motor_halt();
+		}
 		break;
 	}
-done:
 	last = now;
 }
@@ -7,16 +7,17 @@
 #include <serial.h>
 #include <descriptor.h>
 #include <eeprom.h>
+#include <stats.h>
 
-volatile unsigned char	newserial = 0;
 char serialbuffer[8] = "0000000";
 
-void	serial_write() {
-	// make sure 
-	if (!newserial) {
-		return;
-	}
-
+/**
+ * \brief Write the serial number in serialbuffer to the EEPROM
+ *
+ * \return	1 if the serial number was queued for writing, 0 if the
+ *		task has to be retried
+ */
+uint8_t	serial_write() {
 	// find out how many characters there are in the string
 	unsigned char	l = 0;
 	while (0 != serialbuffer[l]) {
@@ -32,15 +33,21 @@ void	serial_write() {
 		descriptor->UnicodeString[i] = serialbuffer[i];
 	}
 
-	// write the string to EEPROM
-	eeprom_write_block(descriptor, &SerialNumberString,
-		descriptor->Header.Size);
+	// queue the string for writing to EEPROM, if there is no room
+	// in the queue, the main loop tries again later
+	if (!eeprom_enqueue(&SerialNumberString, descriptor,
+		descriptor->Header.Size)) {
+		return 0;
+	}
+	stats_increment(&stats.serialwrites);
+
+	// the EEPROM is written in the background, so the new serial
+	// number is copied to RAM directly instead of reading it back
+	for (unsigned char i = 0; i < descriptor->Header.Size; i++) {
+		((unsigned char *)&SerialNumberMemoryString)[i] = buffer[i];
+	}
 
-	// read the serial number
-	serial_read();
-	
-	// remember that the serial number has been written
-	newserial = 0;
+	return 1;
 }
 
 void	serial_read() {
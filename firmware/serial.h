@@ -6,10 +6,11 @@
 #ifndef _serial_h
 #define _serial_h
 
-extern volatile unsigned char	newserial;
+#include <stdint.h>
+
 extern char	serialbuffer[8];
 
-extern void	serial_write();
+extern uint8_t	serial_write();
 extern void	serial_read();
 
 #endif /* _serial_h */
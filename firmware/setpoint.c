@@ -0,0 +1,67 @@
+/*
+ * setpoint.c -- setpoints streamed on the interrupt OUT endpoint
+ *
+ * A host that updates the target at a high rate would pay for a full
+ * control transfer with status stage for each update. Instead, it can
+ * send compact setpoint packets to the interrupt OUT endpoint. The
+ * housekeeping tick posts a task every 10 ms, and once setpoints arrive,
+ * the start of frame interrupt posts it once per millisecond until the
+ * stream stops. The task applies the newest packet that has arrived.
+ * The sequence number of the last applied packet is reported in the
+ * STATUS request, so the host can tell which setpoints were superseded
+ * before the firmware saw them.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <setpoint.h>
+#include <descriptor.h>
+#include <event.h>
+#include <motor.h>
+#include <program.h>
+#include <util/atomic.h>
+
+volatile uint16_t	setpoint_sequence = 0;
+
+/**
+ * \brief Apply the newest setpoint packet, called from the main loop
+ *
+ * All packets waiting in the endpoint are read, only the last one is
+ * applied. Like the SET request, positions at the ends of the range are
+ * ignored, but the sequence number still counts as applied.
+ *
+ * \return	always 1, new packets are picked up after the next frame
+ *		or tick
+ */
+uint8_t	setpoint_task() {
+	if (USB_DeviceState != DEVICE_STATE_Configured) {
+		return 1;
+	}
+	Endpoint_SelectEndpoint(SETPOINT_EPADDR);
+	uint8_t	packet[SETPOINT_PACKET_SIZE];
+	uint8_t	received = 0;
+	while (Endpoint_IsOUTReceived()) {
+		if (Endpoint_BytesInEndpoint() == sizeof(packet)) {
+			Endpoint_Read_Stream_LE(packet, sizeof(packet), NULL);
+			received = 1;
+		}
+		Endpoint_ClearOUT();
+	}
+	if (!received) {
+		return 1;
+	}
+	event_sof_enable();
+	uint32_t	position = packet[0] | ((uint32_t)packet[1] << 8)
+				| ((uint32_t)packet[2] << 16);
+	if ((position != 0) && (position != 0xffffff)) {
+		program_cancel();
+		motor_moveto(position, (packet[3]) ? SPEED_FAST : SPEED_SLOW);
+	}
+	// the USB interrupt reads the sequence number for STATUS
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		setpoint_sequence = packet[4] | (packet[5] << 8);
+	}
+	return 1;
+}
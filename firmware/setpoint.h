@@ -0,0 +1,24 @@
+/*
+ * setpoint.h -- setpoints streamed on the interrupt OUT endpoint
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _setpoint_h
+#define _setpoint_h
+
+#include <stdint.h>
+
+/**
+ * \brief Setpoint packet layout
+ *
+ * A setpoint packet consists of the 24 bit target position, a speed
+ * byte (0 = slow, 1 = fast) and a 16 bit sequence number chosen by the
+ * host, all little endian. Packets of a different size are ignored.
+ */
+#define	SETPOINT_PACKET_SIZE	6
+
+extern volatile uint16_t	setpoint_sequence;
+
+extern uint8_t	setpoint_task();
+
+#endif /* _setpoint_h */
@@ -0,0 +1,133 @@
+/*
+ * settings.c -- configuration block kept in EEPROM and cached in RAM
+ *
+ * Reading the EEPROM is slow and writing it even more so, so neither
+ * may happen in an interrupt handler or with interrupts disabled. All
+ * configuration values therefore live in a single block that is loaded
+ * into RAM at boot. Changes are made to the RAM copy and queued for
+ * writing from the main loop.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <settings.h>
+#include <eeprom.h>
+#include <motor.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
+#include <task.h>
+#include <stats.h>
+
+settings_t	settings;
+
+/**
+ * \brief Compute the checksum of a configuration block
+ */
+static uint8_t	settings_crc(const settings_t *s) {
+	const uint8_t	*p = (const uint8_t *)s;
+	uint8_t	crc = 0xff;
+	for (uint8_t i = 0; i < sizeof(settings_t) - 1; i++) {
+		crc = _crc8_ccitt_update(crc, p[i]);
+	}
+	return crc;
+}
+
+/**
+ * \brief Check that all values in a configuration block are usable
+ */
+static uint8_t	settings_valid(const settings_t *s) {
+	if (s->topspeed > 3) {
+		return 0;
+	}
+	if ((s->backlash == 0xffff) || (s->backlashdir > BACKLASH_UP)) {
+		return 0;
+	}
+	if ((s->savedelay == 0) || (s->savedelay == 0xffff)) {
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * \brief Load the configuration block into RAM
+ *
+ * If the block in the EEPROM is damaged or was written by a different
+ * firmware version, e.g. after upgrading from firmware that kept every
+ * value in its own cell, the block is rebuilt from the old cells where
+ * they contain valid values, and written back.
+ */
+void	settings_read() {
+	eeprom_read_block(&settings, &settingsblock, sizeof(settings));
+	if ((settings.version == SETTINGS_VERSION)
+		&& (settings.crc == settings_crc(&settings))
+		&& settings_valid(&settings)) {
+		return;
+	}
+	settings.version = SETTINGS_VERSION;
+	settings.topspeed = eeprom_read_byte(&topspeed);
+	if (settings.topspeed > 3) {
+		settings.topspeed = 0;
+	}
+	settings.backlash = eeprom_read_word(&backlash);
+	settings.backlashdir = eeprom_read_byte(&backlashdir);
+	if ((settings.backlash == 0xffff)
+		|| (settings.backlashdir > BACKLASH_UP)) {
+		settings.backlash = 0;
+		settings.backlashdir = BACKLASH_UP;
+	}
+	settings.savedelay = eeprom_read_word(&savedelay);
+	if ((settings.savedelay == 0) || (settings.savedelay == 0xffff)) {
+		settings.savedelay = SAVEDELAY_DEFAULT;
+	}
+	settings.jogdelay = JOGDELAY_DEFAULT;
+	settings.jograte = JOGRATE_DEFAULT;
+	for (uint8_t i = 0; i < sizeof(settings.reserved); i++) {
+		settings.reserved[i] = 0;
+	}
+	settings.crc = settings_crc(&settings);
+	task_post(TASK_SETTINGS);
+}
+
+/**
+ * \brief Replace the configuration block
+ *
+ * The version, reserved bytes and crc are filled in by the firmware.
+ * The RAM copy changes immediately, the EEPROM is written later from the
+ * main loop.
+ *
+ * \return	1 if the new values were accepted, 0 if they are invalid
+ */
+uint8_t	settings_update(const settings_t *s) {
+	if (!settings_valid(s)) {
+		return 0;
+	}
+	settings_t	n = *s;
+	n.version = SETTINGS_VERSION;
+	for (uint8_t i = 0; i < sizeof(n.reserved); i++) {
+		n.reserved[i] = 0;
+	}
+	n.crc = settings_crc(&n);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		settings = n;
+	}
+	task_post(TASK_SETTINGS);
+	return 1;
+}
+
+/**
+ * \brief Queue the configuration block for writing to the EEPROM
+ *
+ * \return	1 if the block was queued, 0 if there is no room in the
+ *		EEPROM queue and the main loop has to try again later
+ */
+uint8_t	settings_write() {
+	settings_t	s;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		s = settings;
+	}
+	if (!eeprom_enqueue(&settingsblock, &s, sizeof(s))) {
+		return 0;
+	}
+	stats_increment(&stats.settingswrites);
+	return 1;
+}
@@ -0,0 +1,43 @@
+/*
+ * settings.h -- configuration block kept in EEPROM and cached in RAM
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _settings_h
+#define _settings_h
+
+#include <stdint.h>
+
+/**
+ * \brief Configuration block
+ *
+ * The block is read from the EEPROM once at boot, all other code uses
+ * the copy in RAM. The crc is the CRC8-CCITT of all preceding bytes with
+ * initial value 0xff. New parameters take the place of reserved bytes,
+ * a reserved byte is always 0, so 0 must be a sensible default for any
+ * new parameter.
+ */
+typedef struct {
+	uint8_t	version;
+	uint8_t	topspeed;
+	uint16_t	backlash;
+	uint8_t	backlashdir;
+	uint16_t	savedelay;
+	uint8_t	jogdelay;	/* ticks held before a jog becomes a move */
+	uint8_t	jograte;	/* ticks per jog speed increment */
+	uint8_t	reserved[6];
+	uint8_t	crc;
+} settings_t;
+
+#define	SETTINGS_VERSION	1
+
+#define	JOGDELAY_DEFAULT	30
+#define	JOGRATE_DEFAULT		2
+
+extern settings_t	settings;
+
+extern void	settings_read();
+extern uint8_t	settings_update(const settings_t *s);
+extern uint8_t	settings_write();
+
+#endif /* _settings_h */
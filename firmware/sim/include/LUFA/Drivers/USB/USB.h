@@ -0,0 +1,19 @@
+/*
+ * LUFA/Drivers/USB/USB.h -- types the firmware headers refer to
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_lufa_usb_h
+#define _sim_lufa_usb_h
+
+#include <stdint.h>
+
+typedef struct {
+	struct {
+		uint8_t	Size;
+		uint8_t	Type;
+	} Header;
+	uint16_t	UnicodeString[];
+} USB_Descriptor_String_t;
+
+#endif /* _sim_lufa_usb_h */
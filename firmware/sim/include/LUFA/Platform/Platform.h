@@ -0,0 +1,5 @@
+/*
+ * LUFA/Platform/Platform.h -- nothing needed in the simulation
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
@@ -0,0 +1,11 @@
+/*
+ * avr/eeprom.h -- the simulation has no EEPROM
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_avr_eeprom_h
+#define _sim_avr_eeprom_h
+
+#define	EEMEM
+
+#endif /* _sim_avr_eeprom_h */
@@ -0,0 +1,14 @@
+/*
+ * avr/interrupt.h -- interrupt handlers become ordinary functions that
+ * the simulation calls
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_avr_interrupt_h
+#define _sim_avr_interrupt_h
+
+#define	ISR(vector, ...)	void vector(void)
+#define	ISR_ALIASOF(vector)
+#define	ISR_NOBLOCK
+
+#endif /* _sim_avr_interrupt_h */
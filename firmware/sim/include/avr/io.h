@@ -0,0 +1,51 @@
+/*
+ * avr/io.h -- registers used by the simulated firmware modules
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_avr_io_h
+#define _sim_avr_io_h
+
+#include <stdint.h>
+
+#define	_BV(bit)	(1 << (bit))
+
+extern volatile uint8_t	PORTB, PORTC, PORTD, DDRB, DDRC, DDRD, PIND;
+extern volatile uint8_t	EICRA, EICRB, EIFR, EIMSK, PCMSK1, PCIFR, PCICR;
+extern volatile uint16_t	TCNT1;
+
+#define	PORTB4	4
+#define	PORTB5	5
+#define	PORTB6	6
+#define	PORTB7	7
+#define	PORTC2	2
+#define	PORTC4	4
+#define	PORTC5	5
+#define	PORTC6	6
+#define	PORTD7	7
+#define	PORT3	3
+#define	PORT4	4
+#define	PORT5	5
+#define	PORT6	6
+#define	DDD3	3
+#define	DDD4	4
+#define	DDD5	5
+#define	DDD6	6
+#define	DDD7	7
+#define	ISC30	6
+#define	ISC50	2
+#define	ISC60	4
+#define	ISC70	6
+#define	INTF3	3
+#define	INTF5	5
+#define	INTF6	6
+#define	INTF7	7
+#define	INT3	3
+#define	INT5	5
+#define	INT6	6
+#define	INT7	7
+#define	PCINT12	4
+#define	PCIF1	1
+#define	PCIE1	1
+
+#endif /* _sim_avr_io_h */
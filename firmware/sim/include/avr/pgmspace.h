@@ -0,0 +1,14 @@
+/*
+ * avr/pgmspace.h -- on the host, flash tables are ordinary constants
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_avr_pgmspace_h
+#define _sim_avr_pgmspace_h
+
+#include <stdint.h>
+
+#define	PROGMEM
+#define	pgm_read_word(address)	(*(const uint16_t *)(address))
+
+#endif /* _sim_avr_pgmspace_h */
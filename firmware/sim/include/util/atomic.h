@@ -0,0 +1,23 @@
+/*
+ * util/atomic.h -- atomic blocks block the simulated interrupts
+ *
+ * The simulated step interrupt is a signal handler, so an atomic block
+ * blocks the signal and restores the previous mask when it is left,
+ * also through return.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_util_atomic_h
+#define _sim_util_atomic_h
+
+extern int	sim_cli();
+extern void	sim_restore(int *state);
+
+#define	ATOMIC_RESTORESTATE
+#define	ATOMIC_FORCEON
+
+#define	ATOMIC_BLOCK(type)						\
+	for (int _sim_state __attribute__((cleanup(sim_restore)))	\
+		= sim_cli(), _sim_todo = 1; _sim_todo; _sim_todo = 0)
+
+#endif /* _sim_util_atomic_h */
@@ -0,0 +1,183 @@
+/*
+ * jog.c -- feed button timelines into recv_handler and check the jog
+ *
+ * Every 10 ms housekeeping tick, the receiver pins are set from the
+ * timeline, a pin change runs the pin change interrupt, the step
+ * interrupts due until the tick are run and then recv_handler() is
+ * called. The speed is computed from the time between step pulses and
+ * the distance each pulse moves in its stepping mode.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <sim.h>
+#include <avr/io.h>
+#include <motor.h>
+#include <receiver.h>
+#include <settings.h>
+
+extern void	recv_handler();
+extern void	INT3_vect();
+
+#define	TICK	10000	/* microseconds per housekeeping tick */
+
+/*
+ * Speed tracking, in sixteenth steps per second. Between two pulses
+ * the speed may change by at most MAXCHANGE, the ramp itself changes
+ * it by up to 1.4. The motor can start or stop near the start rate of
+ * its stepping mode without a ramp. A move leaves the ramp at the
+ * second entry, 350 pulses per second, so a larger change is allowed
+ * when speeding up to at most that rate, or slowing down from at most
+ * that rate. This is the case for the shift
+ * down to sixteenth steps for the final approach, and for the shift up
+ * from the top of the sixteenth step ramp, 125 full steps per second,
+ * to the full step mode, which starts at 250 full steps per second.
+ */
+#define	MAXCHANGE	1.45
+#define	STARTRATE(shift)	(1e6 / 2857 * (1 << (shift)) * 1.01)
+
+static uint32_t	lastpulse;
+static int	moving = 0;
+static double	speed = 0;
+static uint8_t	shift = 0;
+static double	maxspeed = 0;
+static double	maxup = 0;
+static double	maxdown = 0;
+
+static void	pulse() {
+	if (!sim_pulses) {
+		return;
+	}
+	if (moving) {
+		double	v = (double)(sim_pulses << sim_shift) * 1e6
+				/ (sim_time - lastpulse);
+		if ((speed > 0) && (v > speed) && (v > STARTRATE(sim_shift))
+			&& (v / speed > maxup)) {
+			maxup = v / speed;
+		}
+		if ((speed > 0) && (v < speed) && (speed > STARTRATE(shift))
+			&& (speed / v > maxdown)) {
+			maxdown = speed / v;
+		}
+		speed = v;
+		if (speed > maxspeed) {
+			maxspeed = speed;
+		}
+	}
+	moving = 1;
+	shift = sim_shift;
+	lastpulse = sim_time;
+}
+
+/**
+ * \brief A button press in a timeline
+ */
+typedef struct {
+	uint8_t		buttons;
+	uint16_t	ticks;		/* duration of the press */
+	uint16_t	pause;		/* ticks until the next press */
+} press_t;
+
+/**
+ * \brief Play a timeline and wait until the motor stops
+ *
+ * \return	the distance moved in full steps
+ */
+static int32_t	play(const char *name, const press_t *timeline, int n) {
+	uint32_t	start = motor_current();
+	uint32_t	tick = sim_time / TICK + 1;
+	moving = 0;
+	speed = maxspeed = maxup = maxdown = 0;
+	double	releasespeed = 0;
+	for (int i = 0; i < n; i++) {
+		for (int t = 0; t < timeline[i].ticks + timeline[i].pause;
+			t++, tick++) {
+			sim_run(tick * TICK);
+			if (!sim_timer_running()) {
+				moving = 0;
+			}
+			uint8_t	buttons = (t < timeline[i].ticks)
+					? timeline[i].buttons : 0;
+			if ((uint8_t)(PIND >> 3) != buttons) {
+				if (!buttons) {
+					releasespeed = speed;
+				}
+				PIND = buttons << 3;
+				INT3_vect();
+			}
+			recv_handler();
+		}
+	}
+	// release all buttons and let the motor come to a stop
+	if (PIND) {
+		releasespeed = speed;
+		PIND = 0;
+		INT3_vect();
+	}
+	for (int t = 0; (t < 10) || sim_timer_running(); t++) {
+		sim_run(sim_time + TICK);
+		recv_handler();
+	}
+	int32_t	distance = (int32_t)motor_current() - (int32_t)start;
+	printf("%-24s %6d steps, top %6.1f steps/s, at release %6.1f, "
+		"last %5.1f, accel x%.2f, decel x%.2f\n", name, distance,
+		maxspeed / 16, releasespeed / 16, speed / 16, maxup, maxdown);
+	SIM_CHECK(motor_current() == motor_target(), "%s: stopped at %06x, "
+		"target %06x", name, motor_current(), motor_target());
+	SIM_CHECK(motor_microstep() == 0, "%s: stopped at microstep %d",
+		name, motor_microstep());
+	return distance;
+}
+
+/**
+ * \brief Check that the motor changed speed along the ramp
+ *
+ * The last pulse before the stop must have been near the start rate.
+ */
+static void	check_smooth(const char *name) {
+	SIM_CHECK(maxup <= MAXCHANGE, "%s: speed jumps up by %.2f", name,
+		maxup);
+	SIM_CHECK(maxdown <= MAXCHANGE, "%s: speed drops by %.2f", name,
+		maxdown);
+	SIM_CHECK(speed <= STARTRATE(shift), "%s: stops from %.1f steps/s",
+		name, speed / 16);
+}
+
+int	main(int argc, char *argv[]) {
+	sim_hook = pulse;
+
+	// short presses nudge by one step each
+	static const press_t	nudge[] = { { RECV_A, 10, 30 } };
+	SIM_CHECK(play("nudge up", nudge, 1) == 1, "nudge up");
+	static const press_t	nudges[] = {
+		{ RECV_B, 10, 10 }, { RECV_B, 10, 10 }, { RECV_B, 10, 30 }
+	};
+	SIM_CHECK(play("three nudges down", nudges, 3) == -3,
+		"three nudges down");
+
+	// holding A or B accelerates, releasing decelerates
+	for (uint8_t top = 0; top < 4; top++) {
+		settings.topspeed = top;
+		char	name[32];
+		static const press_t	hold[] = { { RECV_A, 400, 0 } };
+		snprintf(name, sizeof(name), "hold 4 s, top speed %d", top);
+		SIM_CHECK(play(name, hold, 1) > 0, "%s", name);
+		check_smooth(name);
+		static const press_t	brief[] = { { RECV_B, 60, 0 } };
+		snprintf(name, sizeof(name), "hold 0.6 s, top speed %d", top);
+		SIM_CHECK(play(name, brief, 1) < 0, "%s", name);
+		check_smooth(name);
+	}
+
+	// C runs up at full speed right away and decelerates on release
+	settings.topspeed = 0;
+	static const press_t	fast[] = { { RECV_C, 100, 0 } };
+	SIM_CHECK(play("hold C 1 s", fast, 1) > 0, "hold C");
+	check_smooth("hold C 1 s");
+
+	if (sim_failures) {
+		printf("jog: %d failures\n", sim_failures);
+		return EXIT_FAILURE;
+	}
+	printf("jog: nudges, smooth acceleration and deceleration\n");
+	return EXIT_SUCCESS;
+}
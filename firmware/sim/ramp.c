@@ -0,0 +1,198 @@
+/*
+ * ramp.c -- check that moves follow the acceleration ramp, never
+ *           overshoot the target and count their steps exactly
+ *
+ * The motor code is included, so that the test can look at the ramp
+ * index and the microstep phase after every step interrupt.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <sim.h>
+#include "../motor.c"
+
+static const uint32_t	distances[] = {
+	1, 2, 3, 4, 5, 6, 7, 10, 17, 50, 65, 66, 67, 68, 100, 133, 500, 2000
+};
+#define	NDISTANCES	(sizeof(distances) / sizeof(distances[0]))
+
+/**
+ * \brief Run one move from standstill and check the ramp
+ */
+static void	check_move(uint32_t from, uint32_t to, unsigned char s,
+		uint8_t top) {
+	settings.topspeed = top;
+	motor_position(from);
+	motor_moveto(to, s);
+	int	up = (to > from);
+	uint32_t	last = from;
+	unsigned char	lastindex = 0;
+	unsigned char	lastshift = stepshift;
+	uint32_t	interrupts = 0;
+	uint32_t	microsteps = 0;
+	uint32_t	start = sim_time;
+	while (sim_timer_running()) {
+		sim_step();
+		interrupts++;
+		microsteps += sim_pulses << sim_shift;
+		uint32_t	now = motor_current();
+		// at every full step, the remaining step counter is the
+		// distance to the target
+		if ((microstep == 0) && sim_timer_running()) {
+			uint32_t	distance = (up) ? to - now : now - to;
+			SIM_CHECK(remaining == distance, "%06x -> %06x speed "
+				"%d top %d: %u steps remaining at %06x",
+				from, to, s, top, (unsigned)remaining, now);
+		}
+		// the position only moves towards the target
+		if (up) {
+			SIM_CHECK((now >= last) && (now <= to),
+				"%06x -> %06x speed %d top %d: position %06x "
+				"after %06x", from, to, s, top, now, last);
+		} else {
+			SIM_CHECK((now <= last) && (now >= to),
+				"%06x -> %06x speed %d top %d: position %06x "
+				"after %06x", from, to, s, top, now, last);
+		}
+		last = now;
+		// the ramp index changes by at most one entry, a shift to
+		// another stepping mode starts over at the beginning of the
+		// ramp and may already advance by one entry
+		if (stepshift == lastshift) {
+			SIM_CHECK((rampindex <= lastindex + 1)
+				&& (rampindex + 1 >= lastindex),
+				"%06x -> %06x speed %d top %d: ramp index "
+				"%d after %d", from, to, s, top, rampindex,
+				lastindex);
+		} else {
+			SIM_CHECK(rampindex <= 1,
+				"%06x -> %06x speed %d top %d: ramp index "
+				"%d after shift", from, to, s, top,
+				rampindex);
+		}
+		lastindex = rampindex;
+		lastshift = stepshift;
+		if (interrupts > 10000000) {
+			SIM_CHECK(0, "%06x -> %06x does not stop", from, to);
+			return;
+		}
+	}
+	// the motor stops on the target, at a full step, at the start rate
+	SIM_CHECK(motor_current() == to, "%06x -> %06x speed %d top %d: "
+		"stopped at %06x", from, to, s, top, motor_current());
+	SIM_CHECK(microstep == 0, "%06x -> %06x speed %d top %d: "
+		"microstep %d at stop", from, to, s, top, microstep);
+	SIM_CHECK(rampindex == 0, "%06x -> %06x speed %d top %d: "
+		"ramp index %d at stop", from, to, s, top, rampindex);
+	// no pulse is lost or sent twice
+	uint32_t	distance = (up) ? to - from : from - to;
+	SIM_CHECK(microsteps == 16 * distance, "%06x -> %06x speed %d top %d: "
+		"%u microsteps", from, to, s, top, microsteps);
+	if ((s == SPEED_FAST) && (top == 0) && (to - from == 2000)) {
+		printf("2000 steps fast: %.3f s\n", (sim_time - start) / 1e6);
+	}
+	if ((s == SPEED_SLOW) && (top == 0) && (to - from == 100)) {
+		printf("100 steps slow: %.3f s\n", (sim_time - start) / 1e6);
+	}
+}
+
+/**
+ * \brief Retarget a move after some step interrupts and check the blend
+ *
+ * The motor may only reverse in sixteenth steps near the start rate,
+ * and the net distance of all pulses must be the distance to the new
+ * target.
+ */
+static void	check_retarget(uint32_t from, uint32_t first, uint32_t second,
+		uint32_t after, unsigned char s, uint8_t top) {
+	settings.topspeed = top;
+	motor_position(from);
+	motor_moveto(first, s);
+	int32_t	microsteps = 0;
+	uint32_t	interrupts = 0;
+	unsigned char	lastdirection = direction;
+	unsigned char	lastindex = 0;
+	unsigned char	lastshift = stepshift;
+	int	pulses = 0;
+	while (sim_timer_running()) {
+		if (interrupts == after) {
+			motor_moveto(second, s);
+		}
+		sim_step();
+		interrupts++;
+		if (sim_pulses) {
+			if ((pulses) && (direction != lastdirection)) {
+				SIM_CHECK((lastshift == 0) && (lastindex <= 1),
+					"%06x -> %06x -> %06x after %u speed "
+					"%d top %d: reversal in mode %d at "
+					"ramp index %d", from, first, second,
+					after, s, top, lastshift, lastindex);
+			}
+			int32_t	m = sim_pulses << sim_shift;
+			microsteps += (direction) ? m : -m;
+			lastdirection = direction;
+			pulses = 1;
+		}
+		lastindex = rampindex;
+		lastshift = stepshift;
+		if (interrupts > 10000000) {
+			SIM_CHECK(0, "%06x -> %06x -> %06x after %u does not "
+				"stop", from, first, second, after);
+			return;
+		}
+	}
+	SIM_CHECK(motor_current() == second, "%06x -> %06x -> %06x after %u "
+		"speed %d top %d: stopped at %06x", from, first, second, after,
+		s, top, motor_current());
+	SIM_CHECK((microstep == 0) && (rampindex == 0), "%06x -> %06x -> %06x "
+		"after %u speed %d top %d: microstep %d ramp index %d at stop",
+		from, first, second, after, s, top, microstep, rampindex);
+	SIM_CHECK(microsteps == 16 * ((int32_t)second - (int32_t)from),
+		"%06x -> %06x -> %06x after %u speed %d top %d: %d microsteps",
+		from, first, second, after, s, top, microsteps);
+}
+
+static const uint32_t	afters[] = {
+	0, 1, 2, 15, 16, 17, 40, 100, 300, 1000
+};
+#define	NAFTERS	(sizeof(afters) / sizeof(afters[0]))
+
+static const int32_t	seconds[] = {
+	-1000, -5, -1, 0, 1, 3, 5, 20, 100, 3000
+};
+#define	NSECONDS	(sizeof(seconds) / sizeof(seconds[0]))
+
+int	main(int argc, char *argv[]) {
+	for (unsigned char s = SPEED_SLOW; s <= SPEED_FAST; s++) {
+		for (uint8_t top = 0; top < 4; top++) {
+			for (unsigned i = 0; i < NDISTANCES; i++) {
+				check_move(SIM_START, SIM_START + distances[i],
+					s, top);
+				check_move(SIM_START, SIM_START - distances[i],
+					s, top);
+			}
+		}
+	}
+	for (unsigned char s = SPEED_SLOW; s <= SPEED_FAST; s++) {
+		for (uint8_t top = 0; top < 4; top++) {
+			for (unsigned i = 0; i < NAFTERS; i++) {
+				for (unsigned j = 0; j < NSECONDS; j++) {
+					check_retarget(SIM_START,
+						SIM_START + 1000,
+						SIM_START + seconds[j],
+						afters[i], s, top);
+					check_retarget(SIM_START,
+						SIM_START - 1000,
+						SIM_START - seconds[j],
+						afters[i], s, top);
+				}
+			}
+		}
+	}
+	if (sim_failures) {
+		printf("ramp: %d failures\n", sim_failures);
+		return EXIT_FAILURE;
+	}
+	printf("ramp: all moves and retargeted moves stop on target at the "
+		"start rate, step counts exact\n");
+	return EXIT_SUCCESS;
+}
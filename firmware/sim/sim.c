@@ -0,0 +1,168 @@
+/*
+ * sim.c -- host simulation of the motor and receiver code
+ *
+ * The firmware modules that drive the motor are compiled for the host
+ * against the stub headers in the include directory. This file provides
+ * the registers and the modules they depend on, and runs the step
+ * interrupt in simulated time: timer_schedule() and the intervals
+ * returned by motor_handler() decide when the next step interrupt
+ * happens.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <sim.h>
+#include <signal.h>
+#include <avr/io.h>
+#include <motor.h>
+#include <settings.h>
+#include <stats.h>
+#include <trace.h>
+#include <led.h>
+
+volatile uint8_t	PORTB, PORTC, PORTD, DDRB, DDRC, DDRD, PIND;
+volatile uint8_t	EICRA, EICRB, EIFR, EIMSK, PCMSK1, PCIFR, PCICR;
+volatile uint16_t	TCNT1;
+
+int	sim_failures = 0;
+
+/*
+ * Interrupts: the step interrupt of the stress test is SIGALRM, so
+ * disabling interrupts blocks that signal. Inside the signal handler
+ * the signal is already blocked, like the I flag is cleared in an ISR.
+ */
+int	sim_cli() {
+	sigset_t	set, old;
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigprocmask(SIG_BLOCK, &set, &old);
+	return sigismember(&old, SIGALRM);
+}
+
+void	sim_restore(int *state) {
+	if (*state) {
+		return;
+	}
+	sigset_t	set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+/*
+ * The modules the motor and receiver code call
+ */
+settings_t	settings = {
+	.version = SETTINGS_VERSION,
+	.topspeed = 0,
+	.backlash = 0,
+	.backlashdir = BACKLASH_UP,
+	.savedelay = SAVEDELAY_DEFAULT,
+};
+
+uint8_t	settings_update(const settings_t *s) {
+	settings = *s;
+	return 1;
+}
+
+volatile stats_t	stats;
+
+void	stats_increment(volatile uint16_t *counter) {
+	(*counter)++;
+}
+
+volatile uint8_t	trace_enabled = 0;
+
+void	trace_step(uint32_t position, uint8_t microstep, uint8_t mode,
+		uint16_t interval) {
+}
+
+uint8_t	sim_notified = 0;
+
+void	notify_post(uint8_t type) {
+	sim_notified |= type;
+}
+
+void	task_post(uint8_t tasks) {
+}
+
+uint32_t	journal_read() {
+	return SIM_START;
+}
+
+uint8_t	journal_write(uint32_t position) {
+	return 1;
+}
+
+void	led_on() {
+}
+
+void	led_off() {
+}
+
+void	led_done() {
+}
+
+void	program_cancel() {
+}
+
+/*
+ * Step timer
+ */
+uint32_t	sim_time = 0;
+static uint32_t	sim_next = 0;
+static int	sim_timer = 0;
+uint8_t	sim_pulses = 0;
+uint8_t	sim_shift = 0;
+void	(*sim_hook)() = NULL;
+
+void	timer_schedule(uint16_t ticks) {
+	sim_next = sim_time + ticks;
+	sim_timer = 1;
+}
+
+int	sim_timer_running() {
+	return sim_timer;
+}
+
+/**
+ * \brief Run the next step interrupt
+ *
+ * The pulses sent by the interrupt are found from the step counters.
+ *
+ * \return	the interval returned by motor_handler()
+ */
+uint16_t	sim_step() {
+	uint16_t	before[STATS_MODES];
+	for (int i = 0; i < STATS_MODES; i++) {
+		before[i] = stats.steps[i];
+	}
+	sim_time = sim_next;
+	TCNT1 = sim_time;
+	uint16_t	interval = motor_handler();
+	sim_pulses = 0;
+	for (int i = 0; i < STATS_MODES; i++) {
+		if (stats.steps[i] != before[i]) {
+			sim_pulses += (uint16_t)(stats.steps[i] - before[i]);
+			sim_shift = i;
+		}
+	}
+	if (interval) {
+		sim_next += interval;
+	} else {
+		sim_timer = 0;
+	}
+	if (sim_hook) {
+		sim_hook();
+	}
+	return interval;
+}
+
+/**
+ * \brief Run the step interrupts due until the given time
+ */
+void	sim_run(uint32_t until) {
+	while (sim_timer && (sim_next <= until)) {
+		sim_step();
+	}
+	sim_time = until;
+}
@@ -0,0 +1,58 @@
+/*
+ * sim.h -- host simulation of the motor and receiver code
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _sim_h
+#define _sim_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * \brief Position the simulated journal returns at boot
+ */
+#define	SIM_START	0x800000
+
+/**
+ * \brief Simulated time in microseconds, i.e. timer 1 ticks
+ */
+extern uint32_t	sim_time;
+
+/**
+ * \brief Result of the last simulated step interrupt
+ *
+ * sim_pulses is the number of step pulses sent, sim_shift the step
+ * shift of the stepping mode they were sent in.
+ */
+extern uint8_t	sim_pulses;
+extern uint8_t	sim_shift;
+
+/**
+ * \brief Event types posted with notify_post
+ */
+extern uint8_t	sim_notified;
+
+/**
+ * \brief Function called after every simulated step interrupt, if set
+ */
+extern void	(*sim_hook)();
+
+extern int	sim_timer_running();
+extern uint16_t	sim_step();
+extern void	sim_run(uint32_t until);
+
+extern int	sim_failures;
+
+#define	SIM_CHECK(condition, ...)					\
+	do {								\
+		if (!(condition)) {					\
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);	\
+			fprintf(stderr, __VA_ARGS__);			\
+			fprintf(stderr, "\n");				\
+			sim_failures++;					\
+		}							\
+	} while (0)
+
+#endif /* _sim_h */
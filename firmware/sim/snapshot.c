@@ -0,0 +1,89 @@
+/*
+ * snapshot.c -- read position and target while the step interrupt runs
+ *
+ * The step interrupt is a SIGALRM handler driven by an interval timer.
+ * It runs the next step interrupt of the current move, and when the
+ * motor has stopped, it starts a new move of STRIDE full steps up. The
+ * main program calls motor_status() in a tight loop, like a GET request
+ * in the control endpoint interrupt does. A consistent snapshot has
+ * its target on the grid of move targets and its position within the
+ * last move, and neither goes backwards.
+ *
+ * Reads of 32 bit words are atomic on the host, so this checks that
+ * position and target always come from the same publication, not that
+ * the bytes of a 24 bit value are never torn.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <sim.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+#include <motor.h>
+
+#define	STRIDE	3		/* full steps per move */
+#define	MOVES	5000		/* moves to run */
+#define	SECONDS	20		/* give up after this many seconds */
+
+static volatile uint32_t	interrupts = 0;
+static volatile uint32_t	moves = 0;
+
+static void	step_interrupt(int sig) {
+	interrupts++;
+	if (sim_timer_running()) {
+		sim_step();
+		return;
+	}
+	moves++;
+	motor_moveto(motor_target() + STRIDE, 255);
+}
+
+int	main(int argc, char *argv[]) {
+	motor_position(SIM_START);
+
+	struct sigaction	sa;
+	sa.sa_handler = step_interrupt;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &sa, NULL);
+	struct itimerval	it;
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = 10;
+	it.it_value = it.it_interval;
+	setitimer(ITIMER_REAL, &it, NULL);
+
+	motor_status_t	last = { SIM_START, SIM_START };
+	uint32_t	reads = 0;
+	time_t	start = time(NULL);
+	while ((moves < MOVES) && (time(NULL) - start < SECONDS)
+		&& (sim_failures < 10)) {
+		motor_status_t	status;
+		motor_status(&status);
+		reads++;
+		SIM_CHECK((status.target - SIM_START) % STRIDE == 0,
+			"target %06x off the grid", status.target);
+		SIM_CHECK((status.current <= status.target)
+			&& (status.current + STRIDE >= status.target),
+			"position %06x outside the move to %06x",
+			status.current, status.target);
+		SIM_CHECK((status.current >= last.current)
+			&& (status.target >= last.target),
+			"snapshot %06x/%06x after %06x/%06x", status.current,
+			status.target, last.current, last.target);
+		last = status;
+	}
+
+	it.it_value.tv_usec = 0;
+	it.it_interval.tv_usec = 0;
+	setitimer(ITIMER_REAL, &it, NULL);
+	printf("snapshot: %u reads during %u moves, %u step interrupts\n",
+		reads, moves, interrupts);
+	SIM_CHECK(moves >= MOVES, "only %u moves in %d seconds", moves,
+		SECONDS);
+	if (sim_failures) {
+		printf("snapshot: %d failures\n", sim_failures);
+		return EXIT_FAILURE;
+	}
+	printf("snapshot: all snapshots consistent\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/*
+ * velocity.c -- measure the step frequency in velocity mode
+ *
+ * Each commanded velocity is run until the rate has settled, then the
+ * sixteenth step pulses in a window of simulated time are counted. The
+ * window is long enough for at least 1000 pulses, or 1000 seconds for
+ * very slow velocities.
+ *
+ * Switching between ramp moves and velocity mode must keep the speed:
+ * the gaps between pulses are checked when a fast move hands over to
+ * velocity mode, and when velocity mode hands over to a move.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#include <sim.h>
+#include <math.h>
+#include <motor.h>
+#include <settings.h>
+
+/*
+ * Pulses counted, and the largest gap between two pulses, scaled to
+ * microseconds per sixteenth step
+ */
+static uint32_t	pulses;
+static uint32_t	lastpulse;
+static uint32_t	maxgap;
+
+static void	count() {
+	if (!sim_pulses) {
+		return;
+	}
+	pulses += sim_pulses;
+	uint32_t	gap = (sim_time - lastpulse) >> sim_shift;
+	if (gap > maxgap) {
+		maxgap = gap;
+	}
+	lastpulse = sim_time;
+}
+
+/**
+ * \brief Switch from a cruising move to velocity mode
+ *
+ * The move decelerates along the ramp and shifts down to sixteenth
+ * steps, velocity mode then takes over without a pause.
+ */
+static void	check_enter(uint8_t top, unsigned char s, int32_t velocity) {
+	settings.topspeed = top;
+	motor_position(SIM_START);
+	motor_moveto(SIM_START + 100000, s);
+	sim_run(sim_time + 300000);
+	pulses = 0;
+	maxgap = 0;
+	motor_velocity(velocity);
+	sim_run(sim_time + 500000);
+	// the gaps are at most those of the first ramp entry, at which the
+	// move hands over, or of the new velocity, plus one velocity mode
+	// tick of phase jitter
+	double	interval = 1e6 / (16 * velocity / 1000.);
+	SIM_CHECK(maxgap <= fmax(4000, interval) + 500, "top %d speed %d to "
+		"%.3f steps/s: gap of %u us", top, s, velocity / 1000., maxgap);
+	// the velocity is reached
+	pulses = 0;
+	sim_run(sim_time + 1000000);
+	double	expected = ((velocity * 8192) / 15625) * 15625 / 8192. / 1000;
+	SIM_CHECK(fabs(pulses / 16. - expected) <= 1, "top %d speed %d to "
+		"%.3f steps/s: %.4f steps/s", top, s, velocity / 1000.,
+		pulses / 16.);
+	motor_velocity(0);
+	sim_run(sim_time + 1000000);
+	SIM_CHECK(!sim_timer_running(), "top %d speed %d to %.3f steps/s: "
+		"does not stop", top, s, velocity / 1000.);
+}
+
+/**
+ * \brief Switch from velocity mode to a move
+ *
+ * The move continues at the ramp entry matching the velocity and stops
+ * on its target.
+ */
+static void	check_exit(int32_t velocity, unsigned char s) {
+	settings.topspeed = 0;
+	motor_position(SIM_START);
+	motor_velocity(velocity);
+	sim_run(sim_time + 1000000);
+	uint32_t	to = motor_current() + 500;
+	pulses = 0;
+	maxgap = 0;
+	motor_moveto(to, s);
+	// the first pulses of the move are no further apart than those
+	// of the velocity mode, plus one tick of phase jitter
+	double	interval = 1e6 / (16 * velocity / 1000.);
+	while ((pulses < 20) && sim_timer_running()) {
+		sim_step();
+	}
+	SIM_CHECK(maxgap <= interval + 500, "%.3f steps/s to speed "
+		"%d: gap of %u us", velocity / 1000., s, maxgap);
+	sim_run(sim_time + 10000000);
+	SIM_CHECK(!sim_timer_running() && (motor_current() == to),
+		"%.3f steps/s to speed %d: stopped at %06x, target %06x",
+		velocity / 1000., s, motor_current(), to);
+}
+
+/**
+ * \brief Measure the frequency for one velocity
+ *
+ * \param velocity	in 1/1000 full steps per second
+ */
+static void	measure(int32_t velocity) {
+	motor_position(SIM_START);
+	motor_velocity(velocity);
+	sim_run(sim_time + 1000000);
+	double	v = fabs(velocity / 1000.);
+	if (v > VELOCITY_MAX / 1000.) {
+		v = VELOCITY_MAX / 1000.;
+	}
+	double	window = (v > 0) ? 1000 / (16 * v) : 1;
+	if (window < 1) {
+		window = 1;
+	}
+	if (window > 1000) {
+		window = 1000;
+	}
+	uint32_t	start = motor_current();
+	pulses = 0;
+	sim_run(sim_time + (uint32_t)(window * 1e6));
+	double	measured = pulses / (16 * window);
+	// the phase increment is truncated to an integer, so the expected
+	// frequency is that of the truncated increment
+	uint32_t	rate = (uint32_t)(v * 1000) * 8192 / 15625;
+	double	expected = rate * 15625 / 8192. / 1000;
+	printf("%10.3f steps/s: measured %10.4f, expected %10.4f, "
+		"error %6.3f%%\n", velocity / 1000., measured, expected,
+		(v > 0) ? 100 * (measured - v) / v : 0);
+	// one pulse of uncertainty at either end of the window
+	SIM_CHECK(fabs(measured - expected) <= 2 / (16 * window) + 1e-9,
+		"%.3f steps/s: measured %.4f", velocity / 1000., measured);
+	// the truncation error is at most one unit of the increment
+	if (v > 0) {
+		SIM_CHECK(fabs(expected - v) <= 15625 / 8192. / 1000 + 1e-9,
+			"%.3f steps/s: expected %.4f", velocity / 1000.,
+			expected);
+	}
+	// the motor moves in the commanded direction
+	int32_t	moved = (int32_t)motor_current() - (int32_t)start;
+	SIM_CHECK((pulses < 32) || ((velocity > 0) == (moved > 0)),
+		"%.3f steps/s: moved %d steps", velocity / 1000., moved);
+	// a velocity of 0 decelerates and stops the motor
+	motor_velocity(0);
+	sim_run(sim_time + 1000000);
+	SIM_CHECK(!sim_timer_running(), "%.3f steps/s: does not stop",
+		velocity / 1000.);
+	SIM_CHECK(motor_current() == motor_target(), "%.3f steps/s: stopped "
+		"at %06x, target %06x", velocity / 1000., motor_current(),
+		motor_target());
+}
+
+int	main(int argc, char *argv[]) {
+	static const int32_t	velocities[] = {
+		10, 100, 1000, 2500, 10000, 33333, 100000, 124999, 125000,
+		200000, -10, -1000, -33333, -125000
+	};
+	sim_hook = count;
+	for (unsigned i = 0; i < sizeof(velocities) / sizeof(velocities[0]);
+		i++) {
+		measure(velocities[i]);
+	}
+	for (uint8_t top = 0; top < 4; top++) {
+		for (unsigned char s = SPEED_SLOW; s <= SPEED_FAST; s++) {
+			check_enter(top, s, 125000);
+			check_enter(top, s, 50000);
+			check_enter(top, s, 10000);
+		}
+	}
+	for (unsigned char s = SPEED_SLOW; s <= SPEED_FAST; s++) {
+		check_exit(125000, s);
+		check_exit(60000, s);
+		check_exit(20000, s);
+	}
+	if (sim_failures) {
+		printf("velocity: %d failures\n", sim_failures);
+		return EXIT_FAILURE;
+	}
+	printf("velocity: all frequencies match the phase increment, "
+		"switching keeps the speed\n");
+	return EXIT_SUCCESS;
+}
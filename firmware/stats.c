@@ -0,0 +1,215 @@
+/*
+ * stats.c -- firmware performance counters
+ *
+ * The counters are updated by the interrupt handlers and the main loop,
+ * and read by the STATS request. Each counter group is copied with
+ * interrupts disabled, so the host never sees torn values, but the
+ * step interrupt is only delayed by a few bytes of copying.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <stats.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <LUFA/Drivers/USB/USB.h>
+
+volatile stats_t	stats;
+
+/*
+ * The reset counters have to survive a watchdog reset, so they are not
+ * cleared by the startup code. After a power on reset their content is
+ * undefined, stats_reset() clears them in that case.
+ */
+#define	STATS_RESET_MAGIC	0xa5
+
+static uint8_t	resetflag __attribute__ ((section(".noinit")));
+static uint8_t	wdtresets __attribute__ ((section(".noinit")));
+static uint8_t	resetrequests __attribute__ ((section(".noinit")));
+static uint8_t	resetcause __attribute__ ((section(".noinit")));
+
+/**
+ * \brief Account for one run of an interrupt handler
+ *
+ * The start argument is the value of TCNT1 when the handler started,
+ * this must be called with interrupts disabled. Durations above 4095
+ * ticks are averaged as 4095, so that the scaled average cannot
+ * overflow.
+ */
+void	stats_isr(volatile stats_isr_t *isr, uint16_t start) {
+	uint16_t	duration = TCNT1 - start;
+	isr->count++;
+	isr->average += ((duration > 4095) ? 4095 : duration)
+		- (isr->average >> 4);
+	if (duration > isr->max) {
+		isr->max = duration;
+	}
+}
+
+/**
+ * \brief Increment a 16 bit counter, from any context
+ */
+void	stats_increment(volatile uint16_t *counter) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (*counter < 0xffff) {
+			(*counter)++;
+		}
+	}
+}
+
+/**
+ * \brief Count a vendor request, called from the control request handler
+ *
+ * The request counters are only touched by the control request handler,
+ * which cannot preempt itself, so no locking is needed.
+ */
+void	stats_request(uint8_t request) {
+	if (request >= STATS_REQUESTS) {
+		request = STATS_REQUESTS - 1;
+	}
+	stats.requests[request]++;
+}
+
+/**
+ * \brief Mark the coming watchdog reset as requested by the host
+ */
+void	stats_resetrequest() {
+	resetflag = STATS_RESET_MAGIC;
+}
+
+/**
+ * \brief Count the reset that just happened
+ *
+ * This is called from the startup code with the content of MCUSR,
+ * before the watchdog reset flag is cleared.
+ */
+void	stats_reset(uint8_t mcusr) {
+	if (mcusr & (_BV(PORF) | _BV(BORF))) {
+		wdtresets = 0;
+		resetrequests = 0;
+	}
+	if (mcusr & _BV(WDRF)) {
+		if (resetflag == STATS_RESET_MAGIC) {
+			if (resetrequests < 0xff) {
+				resetrequests++;
+			}
+		} else {
+			if (wdtresets < 0xff) {
+				wdtresets++;
+			}
+		}
+	}
+	resetflag = 0;
+	resetcause = mcusr;
+}
+
+/*
+ * Stack high water mark: before the stack pointer is set up, the startup
+ * code fills all RAM between the end of the static variables and the
+ * top of the stack with STATS_CANARY. Bytes at the bottom of that area
+ * that still hold the pattern have never been used by the stack. There
+ * is no heap, so nothing else writes there.
+ */
+#define	STATS_CANARY	0xc5
+
+extern uint8_t	_end;
+extern uint8_t	__stack;
+
+void	stats_paint(void) __attribute__ ((naked, used, section(".init1")));
+void	stats_paint(void) {
+	__asm volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		: : "i" (STATS_CANARY));
+}
+
+/**
+ * \brief Number of stack bytes that have never been used since reset
+ */
+static uint16_t	stats_stackfree() {
+	const uint8_t	*p = &_end;
+	while ((p <= &__stack) && (*p == STATS_CANARY)) {
+		p++;
+	}
+	return p - &_end;
+}
+
+/*
+ * The counters are written to the control endpoint as a single packet,
+ * so the STATS request needs neither a buffer on the stack nor a zero
+ * length packet at the end.
+ */
+_Static_assert(STATS_SIZE < FIXED_CONTROL_ENDPOINT_SIZE,
+	"STATS reply does not fit into one control packet");
+
+/**
+ * \brief Write a 16 bit counter to the endpoint, and clear it if requested
+ */
+static void	stats_put16(volatile uint16_t *counter, uint8_t clear) {
+	uint16_t	value;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		value = *counter;
+		if (clear) {
+			*counter = 0;
+		}
+	}
+	Endpoint_Write_16_LE(value);
+}
+
+/**
+ * \brief Write an 8 bit counter to the endpoint, and clear it if requested
+ */
+static void	stats_put8(volatile uint8_t *counter, uint8_t clear) {
+	uint8_t	value;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		value = *counter;
+		if (clear) {
+			*counter = 0;
+		}
+	}
+	Endpoint_Write_8(value);
+}
+
+static void	stats_putisr(volatile stats_isr_t *isr, uint8_t clear) {
+	stats_put16(&isr->count, clear);
+	stats_put16(&isr->average, clear);
+	stats_put16(&isr->max, clear);
+}
+
+/**
+ * \brief Write the counters to the selected control endpoint
+ *
+ * The caller has to make sure that the endpoint is ready for the IN
+ * data stage. Each counter is read with interrupts disabled, so the
+ * step interrupt is only delayed by a few instructions.
+ *
+ * \param clear		nonzero to clear the counters after reading,
+ *			the cause of the last reset is always kept
+ */
+void	stats_write(uint8_t clear) {
+	stats_putisr(&stats.step, clear);
+	stats_putisr(&stats.housekeeping, clear);
+	for (uint8_t i = 0; i < STATS_MODES; i++) {
+		stats_put16(&stats.steps[i], clear);
+	}
+	for (uint8_t i = 0; i < STATS_REQUESTS; i++) {
+		stats_put8(&stats.requests[i], clear);
+	}
+	stats_put16(&stats.journalwrites, clear);
+	stats_put16(&stats.serialwrites, clear);
+	stats_put16(&stats.settingswrites, clear);
+	stats_put8(&wdtresets, clear);
+	stats_put8(&resetrequests, clear);
+	stats_put8(&resetcause, 0);
+	Endpoint_Write_16_LE(stats_stackfree());
+}
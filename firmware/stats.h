@@ -0,0 +1,71 @@
+/*
+ * stats.h -- firmware performance counters
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _stats_h
+#define _stats_h
+
+#include <stdint.h>
+
+/**
+ * \brief Interrupt handler duration statistics
+ *
+ * Durations are measured in timer 1 ticks, i.e. microseconds, from the
+ * start of the handler body to its end. The average is a moving average
+ * over about the last 16 runs, kept in 1/16 ticks.
+ */
+typedef struct {
+	uint16_t	count;
+	uint16_t	average;
+	uint16_t	max;
+} stats_isr_t;
+
+/**
+ * \brief Number of vendor request counters
+ *
+ * One counter for each request code up to FOCUSER_STATS, the last one
+ * counts unknown requests.
+ */
+#define	STATS_REQUESTS	20
+
+/**
+ * \brief Number of stepping modes, indexed by the step shift
+ */
+#define	STATS_MODES	5
+
+/**
+ * \brief Counters
+ *
+ * The STATS request sends the counters in this order, little endian,
+ * followed by the number of unexpected watchdog resets, the number of
+ * resets requested by the host, the MCUSR value of the last reset and
+ * the number of stack bytes never used since the last reset (16 bit).
+ * Interrupt, pulse and request counters wrap around, the host either
+ * clears them on every read or takes differences. The EEPROM write
+ * counters saturate. RAM is scarce, so the counters are as small as
+ * that allows.
+ */
+typedef struct {
+	stats_isr_t	step;		/* step interrupt */
+	stats_isr_t	housekeeping;	/* housekeeping interrupt */
+	uint16_t	steps[STATS_MODES];	/* pulses, 0 = sixteenth steps */
+	uint8_t	requests[STATS_REQUESTS];	/* by bRequest */
+	uint16_t	journalwrites;	/* position saves by motor_save */
+	uint16_t	serialwrites;	/* serial numbers by serial_write */
+	uint16_t	settingswrites;	/* configuration blocks, including
+					   top speed changes */
+} stats_t;
+
+#define	STATS_SIZE	(sizeof(stats_t) + 5)
+
+extern volatile stats_t	stats;
+
+extern void	stats_isr(volatile stats_isr_t *isr, uint16_t start);
+extern void	stats_increment(volatile uint16_t *counter);
+extern void	stats_request(uint8_t request);
+extern void	stats_resetrequest();
+extern void	stats_reset(uint8_t mcusr);
+extern void	stats_write(uint8_t clear);
+
+#endif /* _stats_h */
@@ -0,0 +1,100 @@
+/*
+ * task.c -- deferred work for the main loop
+ *
+ * The main loop runs the posted tasks and sleeps when there is nothing
+ * to do. Any interrupt wakes it up. A task that cannot complete, e.g.
+ * because the EEPROM queue is full, is retried after the next interrupt,
+ * at the latest after one housekeeping tick.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <task.h>
+#include <avr/sleep.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include <motor.h>
+#include <serial.h>
+#include <settings.h>
+#include <notify.h>
+#include <setpoint.h>
+#include <trace.h>
+
+volatile uint8_t	task_pending = 0;
+
+/**
+ * \brief Post tasks for the main loop
+ *
+ * This may be called from any context.
+ */
+void	task_post(uint8_t tasks) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		task_pending |= tasks;
+	}
+}
+
+/**
+ * \brief Wait for tasks
+ *
+ * With interrupt driven control requests, the CPU sleeps until the next
+ * interrupt if no task is pending. Interrupts are disabled between the
+ * check and the sleep instruction, and the instruction after sei is
+ * always executed, so a task posted by an interrupt in between cannot
+ * be missed. Without interrupt driven control requests, the main loop
+ * has to poll the control endpoint and cannot sleep.
+ */
+static uint8_t	task_wait() {
+#ifdef INTERRUPT_CONTROL_ENDPOINT
+	cli();
+	if (!task_pending) {
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+#else
+	USB_USBTask();
+#endif /* INTERRUPT_CONTROL_ENDPOINT */
+	uint8_t	tasks;
+	ATOMIC_BLOCK(ATOMIC_FORCEON) {
+		tasks = task_pending;
+		task_pending = 0;
+	}
+	return tasks;
+}
+
+/**
+ * \brief Main loop
+ *
+ * Runs the pending tasks, tasks that have to be retried are kept in
+ * a local mask until the next wake up.
+ */
+void	task_loop() {
+	uint8_t	deferred = 0;
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	for (;;) {
+		uint8_t	tasks = task_wait() | deferred;
+		deferred = 0;
+		if ((tasks & TASK_SAVE) && !motor_save()) {
+			deferred |= TASK_SAVE;
+		}
+		if ((tasks & TASK_SERIAL) && !serial_write()) {
+			deferred |= TASK_SERIAL;
+		}
+		if ((tasks & TASK_SETTINGS) && !settings_write()) {
+			deferred |= TASK_SETTINGS;
+		}
+		if ((tasks & TASK_NOTIFY) && !notify_task()) {
+			deferred |= TASK_NOTIFY;
+		}
+		if ((tasks & TASK_SETPOINT) && !setpoint_task()) {
+			deferred |= TASK_SETPOINT;
+		}
+		if ((tasks & TASK_TRACE) && !trace_task()) {
+			deferred |= TASK_TRACE;
+		}
+	}
+}
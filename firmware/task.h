@@ -0,0 +1,29 @@
+/*
+ * task.h -- deferred work for the main loop
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _task_h
+#define _task_h
+
+#include <stdint.h>
+
+/**
+ * \brief Pending task bits
+ *
+ * Interrupt handlers cannot do slow work like queueing EEPROM writes,
+ * so they post a task bit instead and the main loop does the work.
+ */
+#define	TASK_SAVE	0x01	/* write the position journal */
+#define	TASK_SERIAL	0x02	/* write the serial number */
+#define	TASK_SETTINGS	0x04	/* write the configuration block */
+#define	TASK_NOTIFY	0x08	/* send event records */
+#define	TASK_SETPOINT	0x10	/* apply received setpoints */
+#define	TASK_TRACE	0x20	/* send trace records */
+
+extern volatile uint8_t	task_pending;
+
+extern void	task_post(uint8_t tasks);
+extern void	task_loop() __attribute__ ((noreturn));
+
+#endif /* _task_h */
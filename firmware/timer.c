@@ -9,36 +9,184 @@
 #include <avr/wdt.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
+#include <LUFA/Platform/Platform.h>
 #include <timer.h>
+#include <motor.h>
+#include <program.h>
+#include <led.h>
+#include <stats.h>
+#include <task.h>
 
 void	timer_start() {
-	TIMSK1 |= _BV(OCIE1A);
-	wdt_enable(WDTO_15MS);
+	TIMSK0 |= _BV(OCIE0A);
+	wdt_enable(WDTO_60MS);
 }
 
 void	timer_stop() {
+	TIMSK0 &= ~_BV(OCIE0A);
 	TIMSK1 &= ~_BV(OCIE1A);
 	wdt_disable();
 }
 
+/**
+ * \brief Schedule the first step pulse
+ *
+ * Timer 1 runs freely at one tick per microsecond, the compare register
+ * is moved forward by the step interval in each step interrupt. This
+ * function starts the step interrupt, the first pulse happens after
+ * the given number of ticks. It must be called with interrupts disabled.
+ */
+void	timer_schedule(uint16_t ticks) {
+	OCR1A = TCNT1 + ticks;
+	TIFR1 = _BV(OCF1A);
+	TIMSK1 |= _BV(OCIE1A);
+}
+
+/*
+ * Timer 1 must count microseconds, because the ramp table and all step
+ * intervals are in microseconds. Timer 0 needs a prescaler small enough
+ * for a precise tick but large enough for the compare value to fit into
+ * eight bits.
+ */
+#if (F_CPU == 1000000)
+#define	TIMER1_CLOCKSELECT	(0x1 << CS10)	/* prescaler 1 */
+#define	TIMER0_PRESCALER	64
+#define	TIMER0_CLOCKSELECT	(0x3 << CS00)
+#elif (F_CPU == 8000000)
+#define	TIMER1_CLOCKSELECT	(0x2 << CS10)	/* prescaler 8 */
+#define	TIMER0_PRESCALER	1024
+#define	TIMER0_CLOCKSELECT	(0x5 << CS00)
+#else
+#error "F_CPU must be 1 MHz or 8 MHz"
+#endif
+
 void	timer_setup(void) __attribute__ ((constructor));
 void	timer_setup(void) {
-	// prescaler 8 = 0x2 or 1 = 0x1, default is 1, CTC
-	TCCR1B = (0x1 << CS10) | (1 << WGM12); 
+	// timer 1: one tick per microsecond, normal mode, the step
+	// interrupt is only enabled while the motor is moving
+	TCCR1B = TIMER1_CLOCKSELECT;
 	TCCR1A = 0;
-	OCR1A = 1000;
-	TIMSK1 = _BV(OCIE1A);
+	TIMSK1 = 0;
+	// timer 0: CTC, housekeeping tick
+	TCCR0A = _BV(WGM01);
+	TCCR0B = TIMER0_CLOCKSELECT;
+	OCR0A = F_CPU / TIMER0_PRESCALER / TIMER_TICKS_PER_SECOND - 1;
+	TIMSK0 = _BV(OCIE0A);
 }
 
 extern void	recv_handler();
-extern void	motor_handler();
 
 uint8_t	resetflag = 1;
 
+static volatile uint32_t	uptime = 0;
+static uint8_t	uptimeticks = 0;
+
+/**
+ * \brief Number of seconds since the last reset
+ */
+uint32_t	timer_uptime() {
+	uint32_t	result;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		result = uptime;
+	}
+	return result;
+}
+
+/*
+ * Step interrupt latency, i.e. the number of timer 1 ticks between the
+ * compare match and the first instruction of the interrupt handler body.
+ * The difference between maximum and minimum is the pulse jitter.
+ */
+static volatile uint16_t	latencymin = 0xffff;
+static volatile uint16_t	latencymax = 0;
+
+/**
+ * \brief Read and restart the step interrupt latency measurement
+ *
+ * If no step interrupt happened since the last call, min is 0xffff and
+ * max is 0.
+ */
+void	timer_latency(uint16_t *min, uint16_t *max) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*min = latencymin;
+		*max = latencymax;
+		latencymin = 0xffff;
+		latencymax = 0;
+	}
+}
+
+/*
+ * Minimum number of timer 1 ticks between the end of the step interrupt
+ * handler body and the next compare match. At 1 MHz this covers the
+ * rest of the handler, so a compare value set by a late step interrupt
+ * is never already in the past, which would delay the next pulse by a
+ * full timer 1 wrap of 65.536 ms.
+ */
+#define	STEP_MARGIN	100
+
+/**
+ * \brief Step interrupt
+ *
+ * Reprograms the compare register for the next step pulse, or stops
+ * the step interrupt if the motor has reached the target. This is the
+ * only time critical interrupt, everything else runs in the
+ * housekeeping interrupt, which this interrupt can preempt.
+ */
 ISR(TIMER1_COMPA_vect) {
-	motor_handler();
+	uint16_t	start = TCNT1;
+	uint16_t	latency = start - OCR1A;
+	if (latency < latencymin) {
+		latencymin = latency;
+	}
+	if (latency > latencymax) {
+		latencymax = latency;
+	}
+	uint16_t	interval = motor_handler();
+	if (interval) {
+		// if the interrupt was delayed by more than the interval,
+		// the next pulse comes as soon as possible instead
+		OCR1A += interval;
+		if ((int16_t)(OCR1A - TCNT1) < STEP_MARGIN) {
+			OCR1A = TCNT1 + STEP_MARGIN;
+		}
+	} else {
+		TIMSK1 &= ~_BV(OCIE1A);
+	}
+	stats_isr(&stats.step, start);
+}
+
+/**
+ * \brief Housekeeping interrupt
+ *
+ * Interrupts are enabled right away, so that step pulses and USB are
+ * not delayed by the housekeeping work. The handlers called from here
+ * must protect state shared with other interrupts themselves. They are
+ * not reentrant, and a tick can take longer than 10 ms, e.g. when a
+ * preempting control request waits for the host. So the housekeeping
+ * interrupt itself stays disabled until the tick is done, a tick that
+ * became due in the meantime follows right after. The measured
+ * duration includes the time spent in interrupts preempting it.
+ */
+ISR(TIMER0_COMPA_vect) {
+	TIMSK0 &= ~_BV(OCIE0A);
+	sei();
+	uint16_t	start = TCNT1;
+	if (++uptimeticks == TIMER_TICKS_PER_SECOND) {
+		uptimeticks = 0;
+		uptime++;
+	}
+	led_tick();
+	motor_tick();
+	program_handler();
 	recv_handler();
+	// poll the setpoint endpoint, the start of frame interrupt only
+	// polls it once setpoints arrive
+	task_post(TASK_SETPOINT);
 	if (resetflag) {
 		wdt_reset();
 	}
+	cli();
+	stats_isr(&stats.housekeeping, start);
+	TIMSK0 |= _BV(OCIE0A);
 }
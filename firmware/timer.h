@@ -6,9 +6,22 @@
 #ifndef _timer_h
 #define _timer_h
 
+#include <stdint.h>
+
+/**
+ * \brief Rate of the housekeeping tick
+ *
+ * Receiver polling and the save delay are driven by timer 0 at this
+ * rate, step pulses are scheduled individually by timer 1.
+ */
+#define	TIMER_TICKS_PER_SECOND	100
+
 extern uint8_t	resetflag;
 
 extern void 	timer_stop();
 extern void	timer_start();
+extern void	timer_schedule(uint16_t ticks);
+extern uint32_t	timer_uptime();
+extern void	timer_latency(uint16_t *min, uint16_t *max);
 
 #endif /* _timer_h */
@@ -0,0 +1,148 @@
+/*
+ * trace.c -- motion trace sent to the host on the bulk IN endpoint
+ *
+ * The step interrupt writes compact records into a small ring buffer,
+ * the main loop moves them to the bulk IN endpoint. There is only one
+ * writer and one reader, each of them only changes its own index, so
+ * no locking is needed. If the host does not keep up, records are
+ * dropped and counted, and the next record is a sync record so that
+ * the host can pick up the position again.
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <trace.h>
+#include <descriptor.h>
+#include <util/atomic.h>
+
+/*
+ * The ring holds 16 records, i.e. 8 ms of sixteenth steps at top slow
+ * speed, and costs 64 of the 512 bytes of RAM. The indices run freely,
+ * the number of records in the ring is their difference.
+ */
+#define	TRACE_RECORDS	16
+
+static volatile uint8_t	ring[TRACE_RECORDS][TRACE_RECORD_SIZE];
+static volatile uint8_t	head = 0;
+static volatile uint8_t	tail = 0;
+static volatile uint16_t	lost = 0;
+static volatile uint8_t	epoch = 0;
+static uint8_t	resync = 0;
+static uint32_t	lastposition;
+static uint8_t	lastmicrostep;
+static uint16_t	elapsed;
+
+volatile uint8_t	trace_enabled = 0;
+
+/**
+ * \brief Start or stop tracing
+ *
+ * Starting the trace empties the ring and the lost record counter, the
+ * first record is a sync record. This is called from the USB interrupt,
+ * which may interrupt the main loop while it is copying records, the
+ * epoch counter tells the main loop that its copy is stale.
+ */
+void	trace_enable(uint8_t on) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		head = 0;
+		tail = 0;
+		lost = 0;
+		resync = TRACE_SYNC;
+		elapsed = 0;
+		epoch++;
+		trace_enabled = on;
+	}
+}
+
+/**
+ * \brief Number of records dropped since tracing was started
+ */
+uint16_t	trace_lost() {
+	uint16_t	result;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		result = lost;
+	}
+	return result;
+}
+
+/**
+ * \brief Record the motor state, called from the step interrupt
+ *
+ * Interrupts that leave position and phase unchanged, e.g. in velocity
+ * mode, only add their interval to the time of the next record.
+ */
+void	trace_step(uint32_t position, uint8_t microstep, uint8_t mode,
+		uint16_t interval) {
+	if ((position == lastposition) && (microstep == lastmicrostep)
+		&& (interval)) {
+		elapsed = (0xffff - elapsed > interval)
+				? elapsed + interval : 0xffff;
+		return;
+	}
+	if ((uint8_t)(head - tail) >= TRACE_RECORDS) {
+		if (lost < 0xffff) {
+			lost++;
+		}
+		resync = TRACE_SYNC | TRACE_LOST;
+		return;
+	}
+	volatile uint8_t	*r = ring[head % TRACE_RECORDS];
+	int32_t	delta = position - lastposition;
+	if ((resync) || (delta < -4) || (delta > 3)) {
+		r[0] = (resync | TRACE_SYNC) | microstep;
+		r[1] = position & 0xff;
+		r[2] = (position >> 8) & 0xff;
+		r[3] = (position >> 16) & 0xff;
+		resync = 0;
+	} else {
+		r[0] = mode | ((delta & 0x7) << 3);
+		r[1] = microstep;
+		r[2] = elapsed & 0xff;
+		r[3] = elapsed >> 8;
+	}
+	head++;
+	lastposition = position;
+	lastmicrostep = microstep;
+	elapsed = interval;
+}
+
+/**
+ * \brief Send the buffered records, called from the main loop
+ *
+ * At most one packet is written per call, the start of frame interrupt
+ * wakes up the main loop for the next one.
+ *
+ * \return	always 1
+ */
+uint8_t	trace_task() {
+	if ((!trace_enabled) || (USB_DeviceState != DEVICE_STATE_Configured)) {
+		return 1;
+	}
+	Endpoint_SelectEndpoint(TRACE_EPADDR);
+	if (!Endpoint_IsINReady()) {
+		return 1;
+	}
+	uint8_t	e = epoch;
+	uint8_t	n = head - tail;
+	if (n == 0) {
+		return 1;
+	}
+	if (n > TRACE_EPSIZE / TRACE_RECORD_SIZE) {
+		n = TRACE_EPSIZE / TRACE_RECORD_SIZE;
+	}
+	for (uint8_t i = 0; i < n; i++) {
+		volatile uint8_t	*r = ring[(tail + i) % TRACE_RECORDS];
+		for (uint8_t j = 0; j < TRACE_RECORD_SIZE; j++) {
+			Endpoint_Write_8(r[j]);
+		}
+	}
+	Endpoint_ClearIN();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (e == epoch) {
+			tail += n;
+		}
+	}
+	return 1;
+}
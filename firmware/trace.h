@@ -0,0 +1,48 @@
+/*
+ * trace.h -- motion trace sent to the host on the bulk IN endpoint
+ *
+ * (c) 2026 Prof Dr Andreas Mueller, Hochschule Rapperswil
+ */
+#ifndef _trace_h
+#define _trace_h
+
+#include <stdint.h>
+
+/**
+ * \brief Trace record layout
+ *
+ * All records are 4 bytes. A step record is written for each step
+ * interrupt that changes the position or the microstep phase, and when
+ * the motor stops:
+ *
+ *   byte 0	TRACE_UP if moving up, the position change since the
+ *		previous record as 3 bit signed number in bits 3-5, and the
+ *		step shift (0 = sixteenth steps ... 4 = full steps) in bits 0-2
+ *   byte 1	microstep phase after the interrupt
+ *   byte 2-3	timer ticks since the previous record, 0 for the first
+ *		record of a move, 0xffff if longer
+ *
+ * A step record that changes neither position nor phase marks the end
+ * of a move. The position is only sent in full in a sync record, which
+ * starts the trace and replaces a step record whenever the position
+ * change does not fit or records had to be dropped:
+ *
+ *   byte 0	TRACE_SYNC, TRACE_LOST if records were dropped before this
+ *		one, microstep phase in bits 0-3
+ *   byte 1-3	24 bit position
+ */
+#define	TRACE_SYNC	0x80
+#define	TRACE_LOST	0x40
+#define	TRACE_UP	0x40
+
+#define	TRACE_RECORD_SIZE	4
+
+extern volatile uint8_t	trace_enabled;
+
+extern void	trace_enable(uint8_t on);
+extern uint16_t	trace_lost();
+extern void	trace_step(uint32_t position, uint8_t microstep, uint8_t mode,
+			uint16_t interval);
+extern uint8_t	trace_task();
+
+#endif /* _trace_h */
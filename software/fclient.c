@@ -9,6 +9,8 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <string.h>
+#include <time.h>
+#include <sys/time.h>
 
 /*
  * we have to find out whether this is a sufficiently modern libusb.
@@ -67,6 +69,77 @@ char	*libusb_strerror(int rc) {
 #define FOCUSER_SERIAL	7
 #define FOCUSER_POSITION	8
 #define FOCUSER_TOPSPEED	9
+#define FOCUSER_BACKLASH	10
+#define FOCUSER_PROGRAM	11
+#define FOCUSER_STATUS	12
+#define FOCUSER_MOVE	13
+#define FOCUSER_SAVEDELAY	14
+#define FOCUSER_SETTINGS	15
+#define FOCUSER_VELOCITY	16
+#define FOCUSER_TRACE	17
+#define FOCUSER_STATS	18
+
+/*
+ * Layout of the configuration block returned by the SETTINGS request,
+ * byte offsets into the little endian block
+ */
+#define SETTINGS_SIZE		16
+#define SETTINGS_VERSION	0
+#define SETTINGS_TOPSPEED	1
+#define SETTINGS_BACKLASH	2
+#define SETTINGS_BACKLASHDIR	4
+#define SETTINGS_SAVEDELAY	5
+#define SETTINGS_JOGDELAY	7
+#define SETTINGS_JOGRATE	8
+
+/*
+ * EEPROM endurance and the number of records in the position journal
+ * of the firmware, used to estimate the EEPROM lifetime
+ */
+#define EEPROM_ENDURANCE	100000
+#define JOURNAL_SIZE		64
+
+/*
+ * field selection bits for the STATUS request
+ */
+#define STATUS_POSITION		0x0001
+#define STATUS_TARGET		0x0002
+#define STATUS_SPEED		0x0004
+#define STATUS_MICROSTEP	0x0008
+#define STATUS_RECEIVER		0x0010
+#define STATUS_SAVED		0x0020
+#define STATUS_TOPSPEED		0x0040
+#define STATUS_UPTIME		0x0080
+#define STATUS_PROGRAM		0x0100
+#define STATUS_EEPROM		0x0200
+#define STATUS_LATENCY		0x0400
+#define STATUS_SETPOINT		0x0800
+#define STATUS_ALL		0x0fff
+
+/*
+ * interrupt endpoint for event records, and the event types
+ */
+#define EVENT_ENDPOINT	0x81
+#define NOTIFY_MOVE	0x01
+#define NOTIFY_STOP	0x02
+#define NOTIFY_BUTTONS	0x04
+
+/*
+ * interrupt endpoint for setpoint packets: 24 bit position, speed byte
+ * and 16 bit sequence number, little endian
+ */
+#define SETPOINT_ENDPOINT	0x02
+#define SETPOINT_SIZE		6
+
+/*
+ * bulk endpoint for the motion trace, see trace.h of the firmware for
+ * the record layout
+ */
+#define TRACE_ENDPOINT		0x83
+#define TRACE_PACKET		32
+#define TRACE_RECORD		4
+#define TRACE_SYNC		0x80
+#define TRACE_LOST		0x40
 
 /*
  * display the descriptors, for tesing
@@ -149,6 +222,551 @@ int	show_descriptors(libusb_device_handle *handle) {
 
 extern void	show_version();
 
+/*
+ * extract a little endian field from the status buffer
+ */
+static uint32_t	status_get(unsigned char *buffer, int *l, int size) {
+	uint32_t	value = 0;
+	for (int i = 0; i < size; i++) {
+		value |= (uint32_t)buffer[(*l)++] << (8 * i);
+	}
+	return value;
+}
+
+/*
+ * display the fields of a STATUS request
+ */
+int	show_status(libusb_device_handle *handle, uint16_t fields) {
+	unsigned char	buffer[64];
+	int	rc = libusb_control_transfer(handle,
+		LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE |
+		LIBUSB_ENDPOINT_IN, FOCUSER_STATUS, 
+		0, fields, buffer, sizeof(buffer), 1000);
+	if (rc < 0) {
+		fprintf(stderr, "cannot send STATUS: %s\n",
+			libusb_strerror(rc));
+		return EXIT_FAILURE;
+	}
+	int	l = 0;
+	if (fields & STATUS_POSITION) {
+		printf("current:   %u\n", status_get(buffer, &l, 4));
+	}
+	if (fields & STATUS_TARGET) {
+		printf("target:    %u\n", status_get(buffer, &l, 4));
+	}
+	if (fields & STATUS_SPEED) {
+		printf("speed:     %s\n",
+			(status_get(buffer, &l, 1)) ? "fast" : "slow");
+	}
+	if (fields & STATUS_MICROSTEP) {
+		int	microstep = status_get(buffer, &l, 1);
+		printf("microstep: %d/16, mode %d\n", microstep,
+			status_get(buffer, &l, 1));
+	}
+	if (fields & STATUS_RECEIVER) {
+		uint32_t	r = status_get(buffer, &l, 1);
+		printf("receiver:  %c%c%c%c%s\n",
+			(r & 0x01) ? 'A' : '_',
+			(r & 0x02) ? 'B' : '_',
+			(r & 0x04) ? 'C' : '_',
+			(r & 0x08) ? 'D' : '_',
+			(r & 0x80) ? " (locked)" : "");
+	}
+	if (fields & STATUS_SAVED) {
+		printf("saved:     %u\n", status_get(buffer, &l, 4));
+	}
+	if (fields & STATUS_TOPSPEED) {
+		printf("top speed: %u\n", status_get(buffer, &l, 1));
+	}
+	if (fields & STATUS_UPTIME) {
+		printf("uptime:    %u s\n", status_get(buffer, &l, 4));
+	}
+	if (fields & STATUS_PROGRAM) {
+		printf("program:   %d\n", (int8_t)status_get(buffer, &l, 1));
+	}
+	if (fields & STATUS_EEPROM) {
+		int	pending = status_get(buffer, &l, 1);
+		printf("eeprom:    %d bytes pending, %u written\n", pending,
+			status_get(buffer, &l, 2));
+	}
+	if (fields & STATUS_LATENCY) {
+		uint32_t	min = status_get(buffer, &l, 2);
+		uint32_t	max = status_get(buffer, &l, 2);
+		if (min > max) {
+			printf("latency:   no steps\n");
+		} else {
+			printf("latency:   %u - %u us, jitter %u us\n",
+				min, max, max - min);
+		}
+	}
+	if (fields & STATUS_SETPOINT) {
+		printf("setpoint:  sequence %u\n", status_get(buffer, &l, 2));
+	}
+	if (l != rc) {
+		fprintf(stderr, "status size mismatch: %d != %d\n", rc, l);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * seconds on a monotonic clock
+ */
+static double	now() {
+	struct timespec	ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.;
+}
+
+/*
+ * wait for the focuser to come back after a reset
+ *
+ * The device counts as back when it has been enumerated with a new
+ * address and answers a GET request. Returns the time since start in
+ * seconds, or a negative value on timeout.
+ */
+double	wait_reenumerated(libusb_context *context, uint16_t vid, uint16_t pid,
+		uint8_t oldaddress, double start, double timeout) {
+	while (now() - start < timeout) {
+		usleep(5000);
+		libusb_device	**list;
+		ssize_t	n = libusb_get_device_list(context, &list);
+		libusb_device_handle	*handle = NULL;
+		for (ssize_t i = 0; i < n; i++) {
+			struct libusb_device_descriptor	d;
+			if (libusb_get_device_descriptor(list[i], &d)) {
+				continue;
+			}
+			if ((d.idVendor != vid) || (d.idProduct != pid)) {
+				continue;
+			}
+			if (libusb_get_device_address(list[i]) == oldaddress) {
+				continue;
+			}
+			if (0 == libusb_open(list[i], &handle)) {
+				break;
+			}
+			handle = NULL;
+		}
+		libusb_free_device_list(list, 1);
+		if (NULL == handle) {
+			continue;
+		}
+		int32_t	result[4];
+		int	rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_IN, FOCUSER_GET, 
+			0, 0, (unsigned char *)result, sizeof(result), 100);
+		libusb_close(handle);
+		if (rc == sizeof(result)) {
+			return now() - start;
+		}
+	}
+	return -1;
+}
+
+/*
+ * wait for the focuser to complete the current move or program
+ */
+int	wait_idle(libusb_device_handle *handle, unsigned int timeout) {
+	int	rc = libusb_claim_interface(handle, 0);
+	if (rc) {
+		fprintf(stderr, "cannot claim interface: %s\n",
+			libusb_strerror(rc));
+		return EXIT_FAILURE;
+	}
+	for (;;) {
+		// records may be stale, so the state is checked with GET
+		// after every event
+		int32_t	result[4];
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_IN, FOCUSER_GET, 
+			0, 0, (unsigned char *)result, sizeof(result), 1000);
+		if (rc != sizeof(result)) {
+			fprintf(stderr, "cannot get focuser state\n");
+			return EXIT_FAILURE;
+		}
+		if ((result[0] == result[1]) && (result[3] < 0)) {
+			printf("current: %d\n", result[0]);
+			return EXIT_SUCCESS;
+		}
+		unsigned char	record[6];
+		int	transferred = 0;
+		rc = libusb_interrupt_transfer(handle, EVENT_ENDPOINT,
+			record, sizeof(record), &transferred, timeout);
+		if (rc == LIBUSB_ERROR_TIMEOUT) {
+			fprintf(stderr, "timeout waiting for focuser\n");
+			return EXIT_FAILURE;
+		}
+		if (rc < 0) {
+			fprintf(stderr, "cannot read event: %s\n",
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if ((transferred == sizeof(record))
+			&& (record[0] & NOTIFY_BUTTONS)) {
+			printf("receiver status: %c%c%c%c\n",
+				(record[1] & 0x01) ? 'A' : '_',
+				(record[1] & 0x02) ? 'B' : '_',
+				(record[1] & 0x04) ? 'C' : '_',
+				(record[1] & 0x08) ? 'D' : '_');
+		}
+	}
+}
+
+/*
+ * non-blocking setpoint streaming
+ *
+ * At most one transfer to the setpoint endpoint is in flight. A setpoint
+ * pushed while the previous one is still being sent replaces any other
+ * setpoint waiting behind it, so the device always gets the newest one.
+ * The caller has to run libusb_handle_events_timeout() to complete the
+ * transfers, and must have claimed interface 0.
+ */
+static struct libusb_transfer	*setpoint_transfer = NULL;
+static unsigned char	setpoint_buffer[SETPOINT_SIZE];
+static unsigned char	setpoint_next[SETPOINT_SIZE];
+static int	setpoint_busy = 0;
+static int	setpoint_waiting = 0;
+static int	setpoint_errors = 0;
+
+static int	setpoint_submit() {
+	memcpy(setpoint_buffer, setpoint_next, SETPOINT_SIZE);
+	setpoint_waiting = 0;
+	int	rc = libusb_submit_transfer(setpoint_transfer);
+	if (rc == 0) {
+		setpoint_busy = 1;
+	}
+	return rc;
+}
+
+static void	setpoint_done(struct libusb_transfer *transfer) {
+	setpoint_busy = 0;
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+		setpoint_errors++;
+	}
+	if (setpoint_waiting && setpoint_submit()) {
+		setpoint_errors++;
+	}
+}
+
+int	push_setpoint(libusb_device_handle *handle, uint32_t position,
+		int fast, uint16_t sequence) {
+	if (NULL == setpoint_transfer) {
+		setpoint_transfer = libusb_alloc_transfer(0);
+		if (NULL == setpoint_transfer) {
+			return LIBUSB_ERROR_NO_MEM;
+		}
+		libusb_fill_interrupt_transfer(setpoint_transfer, handle,
+			SETPOINT_ENDPOINT, setpoint_buffer, SETPOINT_SIZE,
+			setpoint_done, NULL, 1000);
+	}
+	setpoint_next[0] = position & 0xff;
+	setpoint_next[1] = (position >> 8) & 0xff;
+	setpoint_next[2] = (position >> 16) & 0xff;
+	setpoint_next[3] = (fast) ? 1 : 0;
+	setpoint_next[4] = sequence & 0xff;
+	setpoint_next[5] = sequence >> 8;
+	setpoint_waiting = 1;
+	if (setpoint_busy) {
+		return 0;
+	}
+	return setpoint_submit();
+}
+
+/*
+ * sequence number of the setpoint the focuser applied last
+ */
+static int	setpoint_applied(libusb_device_handle *handle, uint16_t *sequence) {
+	unsigned char	buffer[2];
+	int	rc = libusb_control_transfer(handle,
+		LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE |
+		LIBUSB_ENDPOINT_IN, FOCUSER_STATUS, 
+		0, STATUS_SETPOINT, buffer, sizeof(buffer), 1000);
+	if (rc != sizeof(buffer)) {
+		return -1;
+	}
+	*sequence = buffer[0] | (buffer[1] << 8);
+	return 0;
+}
+
+/*
+ * stream setpoints and measure the update rate and latency
+ *
+ * Starting at the current position, count setpoints each step further
+ * away are pushed at the given rate. Between the pushes, the sequence
+ * number last applied by the focuser is polled, the latency is the time
+ * from pushing a setpoint until the focuser reports it as applied. It
+ * includes the polling interval, so it is an upper bound.
+ */
+#define	STREAM_HISTORY	256
+
+int	stream_setpoints(libusb_context *context, libusb_device_handle *handle,
+		double rate, int count, int step, int fast) {
+	int	rc = libusb_claim_interface(handle, 0);
+	if (rc) {
+		fprintf(stderr, "cannot claim interface: %s\n",
+			libusb_strerror(rc));
+		return EXIT_FAILURE;
+	}
+	int32_t	result[4];
+	rc = libusb_control_transfer(handle,
+		LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE |
+		LIBUSB_ENDPOINT_IN, FOCUSER_GET, 
+		0, 0, (unsigned char *)result, sizeof(result), 1000);
+	uint16_t	last;
+	if ((rc != sizeof(result)) || setpoint_applied(handle, &last)) {
+		fprintf(stderr, "cannot get focuser state\n");
+		return EXIT_FAILURE;
+	}
+	int32_t	position = result[0];
+	uint16_t	sequence = last;
+	double	pushed[STREAM_HISTORY];
+	int	applied = 0;
+	double	latencymin = 1e9, latencymax = 0, latencysum = 0;
+	struct timeval	zero = { 0, 0 };
+	double	start = now();
+	double	end = start;
+	int	i = 0;
+	while ((i < count) || (last != sequence)) {
+		if (i < count) {
+			if (now() >= start + i / rate) {
+				position += step;
+				if ((position <= 0) || (position >= 0xffffff)) {
+					fprintf(stderr, "position out of range\n");
+					return EXIT_FAILURE;
+				}
+				sequence++;
+				pushed[sequence % STREAM_HISTORY] = now();
+				rc = push_setpoint(handle, position, fast,
+					sequence);
+				if (rc) {
+					fprintf(stderr, "cannot push setpoint: "
+						"%s\n", libusb_strerror(rc));
+					return EXIT_FAILURE;
+				}
+				end = now();
+				i++;
+			}
+		} else if (now() - end > 1) {
+			fprintf(stderr, "timeout waiting for setpoint %u\n",
+				sequence);
+			break;
+		}
+		libusb_handle_events_timeout(context, &zero);
+		uint16_t	s;
+		if (setpoint_applied(handle, &s)) {
+			fprintf(stderr, "cannot get setpoint sequence\n");
+			return EXIT_FAILURE;
+		}
+		if (s != last) {
+			double	latency = now() - pushed[s % STREAM_HISTORY];
+			if (latency < latencymin) {
+				latencymin = latency;
+			}
+			if (latency > latencymax) {
+				latencymax = latency;
+			}
+			latencysum += latency;
+			applied++;
+			last = s;
+		}
+	}
+	double	elapsed = end - start;
+	printf("pushed:    %d setpoints in %.3f s, %.1f/s\n", i, elapsed,
+		(elapsed > 0) ? (i - 1) / elapsed : 0);
+	printf("applied:   %d, superseded %d, transfer errors %d\n",
+		applied, i - applied, setpoint_errors);
+	if (applied) {
+		printf("latency:   %.1f / %.1f / %.1f ms (min/avg/max)\n",
+			1000 * latencymin, 1000 * latencysum / applied,
+			1000 * latencymax);
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * start or stop the motion trace
+ */
+static int	trace_control(libusb_device_handle *handle, int on) {
+	int	rc = libusb_control_transfer(handle,
+		LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE |
+		LIBUSB_ENDPOINT_OUT, FOCUSER_TRACE, 
+		0, on, NULL, 0, 1000);
+	if (rc < 0) {
+		fprintf(stderr, "cannot send TRACE: %s\n", libusb_strerror(rc));
+	}
+	return rc;
+}
+
+/*
+ * record the motion trace to a file
+ *
+ * Records left in the device from an earlier trace are skipped up to
+ * the first sync record. The raw records are written to the file.
+ */
+int	record_trace(libusb_device_handle *handle, const char *filename,
+		double seconds) {
+	int	rc = libusb_claim_interface(handle, 0);
+	if (rc) {
+		fprintf(stderr, "cannot claim interface: %s\n",
+			libusb_strerror(rc));
+		return EXIT_FAILURE;
+	}
+	FILE	*out = fopen(filename, "wb");
+	if (NULL == out) {
+		fprintf(stderr, "cannot open %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	if (trace_control(handle, 1) < 0) {
+		fclose(out);
+		return EXIT_FAILURE;
+	}
+	int	records = 0;
+	int	resyncs = 0;
+	int	synced = 0;
+	int	result = EXIT_SUCCESS;
+	double	start = now();
+	while (now() - start < seconds) {
+		unsigned char	buffer[TRACE_PACKET];
+		int	transferred = 0;
+		rc = libusb_bulk_transfer(handle, TRACE_ENDPOINT, buffer,
+			sizeof(buffer), &transferred, 100);
+		if ((rc < 0) && (rc != LIBUSB_ERROR_TIMEOUT)) {
+			fprintf(stderr, "cannot read trace: %s\n",
+				libusb_strerror(rc));
+			result = EXIT_FAILURE;
+			break;
+		}
+		for (int i = 0; i + TRACE_RECORD <= transferred;
+			i += TRACE_RECORD) {
+			unsigned char	*r = buffer + i;
+			if (r[0] & TRACE_SYNC) {
+				if (synced && (r[0] & TRACE_LOST)) {
+					resyncs++;
+				}
+				synced = 1;
+			}
+			if (!synced) {
+				continue;
+			}
+			fwrite(r, TRACE_RECORD, 1, out);
+			records++;
+		}
+	}
+	trace_control(handle, 0);
+	fclose(out);
+	unsigned char	v[3];
+	rc = libusb_control_transfer(handle,
+		LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE |
+		LIBUSB_ENDPOINT_IN, FOCUSER_TRACE, 
+		0, 0, v, sizeof(v), 1000);
+	if (rc != sizeof(v)) {
+		fprintf(stderr, "cannot get trace state\n");
+		return EXIT_FAILURE;
+	}
+	int	lost = v[0] | (v[1] << 8);
+	printf("records:   %d in %.1f s\n", records, now() - start);
+	if (lost) {
+		printf("overruns:  %s%d records lost, %d gaps\n",
+			(lost == 0xffff) ? "at least " : "", lost, resyncs);
+	} else {
+		printf("overruns:  none\n");
+	}
+	return result;
+}
+
+/*
+ * display the performance counters
+ *
+ * See stats.h of the firmware for the layout. If clear is set, the
+ * firmware clears the counters after reading them.
+ */
+#define STATS_REQUESTS	20
+#define STATS_MODES	5
+
+static const char	*request_names[STATS_REQUESTS] = {
+	"RESET", "GET", "SET", "LOCK", "RCVR", "STOP", "SAVED", "SERIAL",
+	"POSITION", "TOPSPEED", "BACKLASH", "PROGRAM", "STATUS", "MOVE",
+	"SAVEDELAY", "SETTINGS", "VELOCITY", "TRACE", "STATS", "other"
+};
+
+static const char	*mode_names[STATS_MODES] = {
+	"sixteenth", "eighth", "quarter", "half", "full"
+};
+
+static void	show_isr(const char *name, unsigned char *buffer, int *l) {
+	uint32_t	count = status_get(buffer, l, 2);
+	uint32_t	average = status_get(buffer, l, 2);
+	uint32_t	max = status_get(buffer, l, 2);
+	if (count) {
+		printf("%-13s %u calls, avg %.1f us, max %u us\n", name,
+			count, average / 16., max);
+	} else {
+		printf("%-13s no calls\n", name);
+	}
+}
+
+int	show_stats(libusb_device_handle *handle, int clear) {
+	unsigned char	buffer[128];
+	int	rc = libusb_control_transfer(handle,
+		LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE |
+		LIBUSB_ENDPOINT_IN, FOCUSER_STATS, 
+		0, (clear) ? 1 : 0, buffer, sizeof(buffer), 1000);
+	if (rc < 0) {
+		fprintf(stderr, "cannot send STATS: %s\n",
+			libusb_strerror(rc));
+		return EXIT_FAILURE;
+	}
+	int	size = 2 * 6 + 2 * STATS_MODES + STATS_REQUESTS + 3 * 2 + 3 + 2;
+	if (rc != size) {
+		fprintf(stderr, "stats size mismatch: %d != %d\n", rc, size);
+		return EXIT_FAILURE;
+	}
+	int	l = 0;
+	show_isr("step isr:", buffer, &l);
+	show_isr("housekeeping:", buffer, &l);
+	for (int i = STATS_MODES - 1; i >= 0; i--) {
+		uint32_t	pulses = status_get(buffer, &l, 2);
+		if (pulses) {
+			printf("%-13s %u pulses\n", mode_names[i], pulses);
+		}
+	}
+	for (int i = 0; i < STATS_REQUESTS; i++) {
+		uint32_t	count = status_get(buffer, &l, 1);
+		if (count) {
+			printf("%-13s %u requests\n", request_names[i], count);
+		}
+	}
+	uint32_t	journal = status_get(buffer, &l, 2);
+	uint32_t	serial = status_get(buffer, &l, 2);
+	uint32_t	settings = status_get(buffer, &l, 2);
+	printf("eeprom:       %u position, %u serial, %u settings writes\n",
+		journal, serial, settings);
+	uint32_t	wdt = status_get(buffer, &l, 1);
+	uint32_t	requested = status_get(buffer, &l, 1);
+	uint32_t	mcusr = status_get(buffer, &l, 1);
+	printf("resets:       %u watchdog, %u requested, last:%s%s%s%s%s\n",
+		wdt, requested,
+		(mcusr & 0x01) ? " power on" : "",
+		(mcusr & 0x02) ? " external" : "",
+		(mcusr & 0x04) ? " brown out" : "",
+		(mcusr & 0x08) ? " watchdog" : "",
+		(mcusr & 0x20) ? " usb" : "");
+	uint32_t	stackfree = status_get(buffer, &l, 2);
+	printf("stack:        %u bytes never used since reset\n", stackfree);
+	return EXIT_SUCCESS;
+}
+
 /*
  * Show usage message
  */
@@ -156,32 +774,79 @@ void	usage(const char *progname) {
 	printf("Client program to control the othello Focuser controller hardware.\n");
 	printf("Usage:\n\n");
 	printf("  %s [ options ] get\n", progname);
+	printf("  %s [ options ] status [ <mask> ]\n", progname);
 	printf("  %s [ options ] set <value>\n", progname);
+	printf("  %s [ options ] move <delta>\n", progname);
+	printf("  %s [ options ] velocity <steps per second>\n", progname);
 	printf("  %s [ options ] up\n", progname);
 	printf("  %s [ options ] down\n", progname);
 	printf("  %s [ options ] stop\n", progname);
-	printf("  %s [ options ] position <value>\n\n", progname);
-	printf("To move the focuser to a new position, use the set command. Fast moves can\n");
+	printf("  %s [ options ] position <value>\n", progname);
+	printf("  %s [ options ] program [ <value>[:<dwell>] ... ]\n", progname);
+	printf("  %s [ options ] wait [ <timeout> ]\n", progname);
+	printf("  %s [ options ] stream <rate> <count> [ <step> ]\n", progname);
+	printf("  %s [ options ] trace <file> [ <seconds> ]\n", progname);
+	printf("  %s [ options ] stats [ clear ]\n\n", progname);
+	printf("To move the focuser to a new position, use the set command, or the move\n");
+	printf("command to change the target by a signed number of steps. Fast moves can\n");
 	printf("be done using the -f option. Stop movement with the stop command, and stay\n");
 	printf("informed about the current position of the moving focuser using the get\n");
-	printf("command. The up and down commands are equivalent to setting the extreme\n");
+	printf("command, or get all state information at once with the status command.\n");
+	printf("The up and down commands are equivalent to setting the extreme\n");
 	printf("values of the focuser. The position command sets the internal focuser\n");
-	printf("position without moving the motor.\n\n");
+	printf("position without moving the motor. The program command uploads a list of\n");
+	printf("up to 8 positions which the focuser visits in turn, waiting <dwell> ms at\n");
+	printf("each of them. Without arguments, a running program is cancelled. The wait\n");
+	printf("command blocks until the focuser has stopped, at most <timeout> seconds.\n");
+	printf("The velocity command moves the focuser continuously at a signed velocity\n");
+	printf("of at most 125 steps per second, fractions are allowed, 0 stops it.\n");
+	printf("The stream command sends <count> setpoints, each <step> steps (default 1)\n");
+	printf("beyond the previous one, at <rate> per second to the setpoint endpoint,\n");
+	printf("and reports the achieved update rate and the latency until the focuser\n");
+	printf("has applied them.\n");
+	printf("The trace command records the step timeline of the focuser to <file>\n");
+	printf("for <seconds> (default 10) and reports records lost in overruns.\n");
+	printf("The stats command shows the performance counters of the firmware:\n");
+	printf("interrupt durations, pulses per stepping mode, requests, EEPROM writes,\n");
+	printf("resets and unused stack. With the clear argument, the counters are reset, otherwise\n");
+	printf("the interrupt, pulse and request counters wrap around.\n\n");
 	printf("  %s [ options ] receiver\n", progname);
 	printf("  %s [ options ] [ lock | unlock ]\n\n", progname),
 	printf("Get information about the receiver buttons, lock or unlock the them\n\n");
-	printf("  %s [ options ] reset\n", progname);
+	printf("  %s [ options ] reset [ wait ]\n", progname);
 	printf("  %s [ options ] descriptors\n", progname);
 	printf("  %s [ options ] serial <serial>\n", progname);
 	printf("  %s [ options ] gettop\n", progname);
 	printf("  %s [ options ] settop <0-3>\n", progname);
+	printf("  %s [ options ] getbacklash\n", progname);
+	printf("  %s [ options ] setbacklash <steps> [ up | down ]\n", progname);
+	printf("  %s [ options ] getsave\n", progname);
+	printf("  %s [ options ] setsave <seconds>\n", progname);
+	printf("  %s [ options ] settings [ <name>=<value> ... ]\n", progname);
+	printf("  %s [ options ] lifetime <saves per day>\n", progname);
 	printf("  %s [ options ] help\n\n", progname);
-	printf("The reset command reboots the focuser hardware. The descriptors command\n");
-	printf("displays the USB descriptors of the device, shows serial number among others.\n");
+	printf("The setbacklash command makes the focuser overshoot moves against the given\n");
+	printf("final approach direction by <steps> and come back, 0 steps disables it.\n");
+	printf("The setsave command sets how long the motor has to be idle before the\n");
+	printf("position is saved (default 10 seconds). The focuser also tries to save\n");
+	printf("it when the USB bus is suspended or disconnected, but after an unplug\n");
+	printf("of a bus powered focuser that save usually does not complete.\n");
+	printf("The settings command shows the configuration block, or changes the named\n");
+	printf("values topspeed, backlash, backlashdir (up or down), savedelay, jogdelay\n");
+	printf("and jograte in one transfer. A short press of button A or B on the remote\n");
+	printf("moves one step, holding it for jogdelay ticks starts a move that speeds\n");
+	printf("up every jograte ticks, a tick is 10 ms.\n");
+	printf("The reset command reboots the focuser hardware, with the wait argument\n");
+	printf("it waits until the focuser answers again and reports how long that took.\n");
+	printf("The descriptors command displays the USB descriptors of the device, shows\n");
+	printf("the serial number among others.\n");
+	printf("The lifetime command estimates how long the EEPROM position journal lasts\n");
+	printf("if the position is saved the given number of times per day, it does not\n");
+	printf("need a device.\n");
 	printf("The help command displays this message, just like the --help option.\n\n");
 	printf("Options:\n");
 	printf("  -d,--debug           enable USB debugging\n");
-	printf("  -f,--fast            fast movement (500 steps/s instead of 62, \n");
+	printf("  -f,--fast            fast movement (2000 steps/s instead of 125,\n");
 	printf("                       set command only\n");
 	printf("  -h,-?,--help         display this help and exit\n");
 	printf("  -p,--product=<pid>   use this product id to connect (default 0x1235)\n");
@@ -249,6 +914,27 @@ int	main(int argc, char *argv[]) {
 	}
 	
 
+	// the lifetime estimate does not need a device either
+	if (0 == strcmp(command, "lifetime")) {
+		if (optind >= argc) {
+			fprintf(stderr, "number of saves per day missing\n");
+			return EXIT_FAILURE;
+		}
+		double	rate = atof(argv[optind]);
+		if (rate <= 0) {
+			fprintf(stderr, "not a valid save rate\n");
+			return EXIT_FAILURE;
+		}
+		// every record is written once per JOURNAL_SIZE saves
+		double	days = (double)EEPROM_ENDURANCE * JOURNAL_SIZE / rate;
+		printf("journal of %d records: %.0f days (%.1f years)\n",
+			JOURNAL_SIZE, days, days / 365.25);
+		printf("single position cell:  %.0f days (%.1f years)\n",
+			EEPROM_ENDURANCE / rate,
+			EEPROM_ENDURANCE / rate / 365.25);
+		return EXIT_SUCCESS;
+	}
+
 	// initialize libusb library
 	libusb_context	*context;
 	libusb_init(&context);
@@ -316,10 +1002,61 @@ int	main(int argc, char *argv[]) {
 		return EXIT_SUCCESS;
 	}
 
+	// move command implementation
+	if (0 == strcmp(command, "move")) {
+		if (optind >= argc) {
+			fprintf(stderr, "no argument to move given\n");
+			return EXIT_FAILURE;
+		}
+		int32_t	delta = atoi(argv[optind++]);
+		if ((delta < -0x800000) || (delta > 0x7fffff)) {
+			fprintf(stderr, "delta %d out of range\n", delta);
+			return EXIT_FAILURE;
+		}
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_OUT, FOCUSER_MOVE, 
+			value, index, (unsigned char *)&delta,
+			sizeof(delta), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send MOVE: %s\n", 
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// velocity command
+	if (0 == strcmp(command, "velocity")) {
+		if (optind >= argc) {
+			fprintf(stderr, "no velocity given\n");
+			return EXIT_FAILURE;
+		}
+		double	v = atof(argv[optind++]);
+		if ((v < -125) || (v > 125)) {
+			fprintf(stderr, "velocity %f out of range\n", v);
+			return EXIT_FAILURE;
+		}
+		int32_t	velocity = (v < 0) ? (v * 1000 - 0.5) : (v * 1000 + 0.5);
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_OUT, FOCUSER_VELOCITY, 
+			0, 0, (unsigned char *)&velocity,
+			sizeof(velocity), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send VELOCITY: %s\n", 
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 	// get command implementation
 	if (0 == strcmp(command, "get")) {
 		index = 0xf;
-		int32_t	result[3];
+		int32_t	result[4];
 		rc = libusb_control_transfer(handle,
 			LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_RECIPIENT_DEVICE |
@@ -330,7 +1067,8 @@ int	main(int argc, char *argv[]) {
 				libusb_strerror(rc));
 			return EXIT_FAILURE;
 		}
-		if (rc != sizeof(result)) {
+		// older firmware does not report the program segment
+		if (rc < 3 * sizeof(int32_t)) {
 			fprintf(stderr, "focuser position not received\n");
 			return EXIT_FAILURE;
 		}
@@ -342,9 +1080,21 @@ int	main(int argc, char *argv[]) {
 				result[0], result[1],
 				(result[2]) ? "fast" : "slow");
 		}
+		if ((rc == sizeof(result)) && (result[3] >= 0)) {
+			printf("program segment: %d\n", result[3]);
+		}
 		return EXIT_SUCCESS;
 	}
 
+	// status command implementation
+	if (0 == strcmp(command, "status")) {
+		uint16_t	fields = STATUS_ALL;
+		if (optind < argc) {
+			fields = strtol(argv[optind], NULL, 0);
+		}
+		return show_status(handle, fields);
+	}
+
 	// get the configured top speed
 	if (0 == strcmp(command, "gettop")) {
 		unsigned char	result;
@@ -485,6 +1235,9 @@ int	main(int argc, char *argv[]) {
 
 	// reset command
 	if (0 == strcmp(command, "reset")) {
+		uint8_t	oldaddress
+			= libusb_get_device_address(libusb_get_device(handle));
+		double	start = now();
 		rc = libusb_control_transfer(handle,
 			LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_RECIPIENT_DEVICE |
@@ -495,6 +1248,16 @@ int	main(int argc, char *argv[]) {
 				libusb_strerror(rc), rc);
 			return EXIT_FAILURE;
 		}
+		if ((optind < argc) && (0 == strcmp(argv[optind], "wait"))) {
+			libusb_close(handle);
+			double	t = wait_reenumerated(context, vid, pid,
+				oldaddress, start, 10);
+			if (t < 0) {
+				fprintf(stderr, "focuser did not come back\n");
+				return EXIT_FAILURE;
+			}
+			printf("reset to enumerated: %.3f s\n", t);
+		}
 		return EXIT_SUCCESS;
 	}
 
@@ -554,6 +1317,293 @@ int	main(int argc, char *argv[]) {
 		return EXIT_SUCCESS;
 	}
 
+	// get the backlash compensation
+	if (0 == strcmp(command, "getbacklash")) {
+		unsigned char	result[3];
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_IN, FOCUSER_BACKLASH, 
+			0, 0, result, sizeof(result), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send BACKLASH command: %s\n",
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if (rc != sizeof(result)) {
+			fprintf(stderr, "focuser backlash not received\n");
+			return EXIT_FAILURE;
+		}
+		printf("backlash: %d, final approach: %s\n",
+			result[0] | (result[1] << 8),
+			(result[2]) ? "up" : "down");
+		return EXIT_SUCCESS;
+	}
+
+	// set backlash command
+	if (0 == strcmp(command, "setbacklash")) {
+		if (optind >= argc) {
+			fprintf(stderr, "backlash argument missing\n");
+			return EXIT_FAILURE;
+		}
+		int	steps = atoi(argv[optind++]);
+		if ((steps < 0) || (steps >= 0xffff)) {
+			fprintf(stderr, "not a valid backlash value\n");
+			return EXIT_FAILURE;
+		}
+		unsigned char	data[3] = { steps & 0xff, steps >> 8, 1 };
+		if (optind < argc) {
+			if (0 == strcmp(argv[optind], "down")) {
+				data[2] = 0;
+			} else if (0 != strcmp(argv[optind], "up")) {
+				fprintf(stderr, "direction must be up or down\n");
+				return EXIT_FAILURE;
+			}
+		}
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_OUT, FOCUSER_BACKLASH, 
+			0, 0, data, sizeof(data), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send BACKLASH: %s\n", 
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if (rc != sizeof(data)) {
+			fprintf(stderr, "could not send backlash %d\n", steps);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// get the save delay
+	if (0 == strcmp(command, "getsave")) {
+		unsigned char	result[2];
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_IN, FOCUSER_SAVEDELAY, 
+			0, 0, result, sizeof(result), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send SAVEDELAY command: %s\n",
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if (rc != sizeof(result)) {
+			fprintf(stderr, "save delay not received\n");
+			return EXIT_FAILURE;
+		}
+		printf("save delay: %d seconds\n", result[0] | (result[1] << 8));
+		return EXIT_SUCCESS;
+	}
+
+	// set the save delay
+	if (0 == strcmp(command, "setsave")) {
+		if (optind >= argc) {
+			fprintf(stderr, "save delay argument missing\n");
+			return EXIT_FAILURE;
+		}
+		int	seconds = atoi(argv[optind++]);
+		if ((seconds <= 0) || (seconds >= 0xffff)) {
+			fprintf(stderr, "not a valid save delay\n");
+			return EXIT_FAILURE;
+		}
+		unsigned char	data[2] = { seconds & 0xff, seconds >> 8 };
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_OUT, FOCUSER_SAVEDELAY, 
+			0, 0, data, sizeof(data), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send SAVEDELAY: %s\n", 
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if (rc != sizeof(data)) {
+			fprintf(stderr, "could not send save delay %d\n", seconds);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// settings command
+	if (0 == strcmp(command, "settings")) {
+		unsigned char	block[SETTINGS_SIZE];
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_IN, FOCUSER_SETTINGS, 
+			0, 0, block, sizeof(block), 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send SETTINGS command: %s\n",
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if (rc != sizeof(block)) {
+			fprintf(stderr, "settings not received\n");
+			return EXIT_FAILURE;
+		}
+		int	changed = 0;
+		while (optind < argc) {
+			char	*name = argv[optind++];
+			char	*value = strchr(name, '=');
+			if (NULL == value) {
+				fprintf(stderr, "'%s' is not name=value\n", name);
+				return EXIT_FAILURE;
+			}
+			*value++ = '\0';
+			int	v = atoi(value);
+			if (0 == strcmp(name, "topspeed")) {
+				block[SETTINGS_TOPSPEED] = v;
+			} else if (0 == strcmp(name, "backlash")) {
+				block[SETTINGS_BACKLASH] = v & 0xff;
+				block[SETTINGS_BACKLASH + 1] = (v >> 8) & 0xff;
+			} else if (0 == strcmp(name, "backlashdir")) {
+				block[SETTINGS_BACKLASHDIR]
+					= (0 == strcmp(value, "down")) ? 0 : 1;
+			} else if (0 == strcmp(name, "savedelay")) {
+				block[SETTINGS_SAVEDELAY] = v & 0xff;
+				block[SETTINGS_SAVEDELAY + 1] = (v >> 8) & 0xff;
+			} else if (0 == strcmp(name, "jogdelay")) {
+				block[SETTINGS_JOGDELAY] = v;
+			} else if (0 == strcmp(name, "jograte")) {
+				block[SETTINGS_JOGRATE] = v;
+			} else {
+				fprintf(stderr, "unknown setting '%s'\n", name);
+				return EXIT_FAILURE;
+			}
+			changed = 1;
+		}
+		if (changed) {
+			rc = libusb_control_transfer(handle,
+				LIBUSB_REQUEST_TYPE_VENDOR |
+				LIBUSB_RECIPIENT_DEVICE |
+				LIBUSB_ENDPOINT_OUT, FOCUSER_SETTINGS, 
+				0, 0, block, sizeof(block), 1000);
+			if (rc == LIBUSB_ERROR_PIPE) {
+				fprintf(stderr, "settings refused, "
+					"invalid value\n");
+				return EXIT_FAILURE;
+			}
+			if (rc < 0) {
+				fprintf(stderr, "cannot send SETTINGS: %s\n", 
+					libusb_strerror(rc));
+				return EXIT_FAILURE;
+			}
+			if (rc != sizeof(block)) {
+				fprintf(stderr, "could not send settings\n");
+				return EXIT_FAILURE;
+			}
+			return EXIT_SUCCESS;
+		}
+		printf("version:     %d\n", block[SETTINGS_VERSION]);
+		printf("topspeed:    %d\n", block[SETTINGS_TOPSPEED]);
+		printf("backlash:    %d\n", block[SETTINGS_BACKLASH]
+			| (block[SETTINGS_BACKLASH + 1] << 8));
+		printf("backlashdir: %s\n",
+			(block[SETTINGS_BACKLASHDIR]) ? "up" : "down");
+		printf("savedelay:   %d\n", block[SETTINGS_SAVEDELAY]
+			| (block[SETTINGS_SAVEDELAY + 1] << 8));
+		printf("jogdelay:    %d\n", block[SETTINGS_JOGDELAY]);
+		printf("jograte:     %d\n", block[SETTINGS_JOGRATE]);
+		return EXIT_SUCCESS;
+	}
+
+	// program command
+	if (0 == strcmp(command, "program")) {
+		unsigned char	data[8 * 6];
+		int	l = 0;
+		while (optind < argc) {
+			if (l >= sizeof(data)) {
+				fprintf(stderr, "too many program segments\n");
+				return EXIT_FAILURE;
+			}
+			int	dwell = 0;
+			char	*colon = strchr(argv[optind], ':');
+			if (colon) {
+				dwell = atoi(colon + 1);
+			}
+			position = atoi(argv[optind++]);
+			if ((position <= 0) || (position >= 0xffffff)
+				|| (dwell < 0) || (dwell > 0xffff)) {
+				fprintf(stderr, "invalid program segment\n");
+				return EXIT_FAILURE;
+			}
+			data[l++] = position & 0xff;
+			data[l++] = (position >> 8) & 0xff;
+			data[l++] = (position >> 16) & 0xff;
+			data[l++] = (fast) ? 1 : 0;
+			data[l++] = dwell & 0xff;
+			data[l++] = dwell >> 8;
+		}
+		rc = libusb_control_transfer(handle,
+			LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE |
+			LIBUSB_ENDPOINT_OUT, FOCUSER_PROGRAM, 
+			0, 0, data, l, 1000);
+		if (rc < 0) {
+			fprintf(stderr, "cannot send PROGRAM: %s\n", 
+				libusb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+		if (rc != l) {
+			fprintf(stderr, "could not send program\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// wait command
+	if (0 == strcmp(command, "wait")) {
+		unsigned int	timeout = 0;
+		if (optind < argc) {
+			timeout = 1000 * atoi(argv[optind]);
+		}
+		return wait_idle(handle, timeout);
+	}
+
+	// stream command
+	if (0 == strcmp(command, "stream")) {
+		if (optind + 1 >= argc) {
+			fprintf(stderr, "rate and count required\n");
+			return EXIT_FAILURE;
+		}
+		double	rate = atof(argv[optind++]);
+		int	count = atoi(argv[optind++]);
+		int	step = 1;
+		if (optind < argc) {
+			step = atoi(argv[optind++]);
+		}
+		if ((rate <= 0) || (count <= 0)) {
+			fprintf(stderr, "invalid rate or count\n");
+			return EXIT_FAILURE;
+		}
+		return stream_setpoints(context, handle, rate, count, step,
+			fast);
+	}
+
+	// trace command
+	if (0 == strcmp(command, "trace")) {
+		if (optind >= argc) {
+			fprintf(stderr, "no trace file given\n");
+			return EXIT_FAILURE;
+		}
+		const char	*filename = argv[optind++];
+		double	seconds = 10;
+		if (optind < argc) {
+			seconds = atof(argv[optind++]);
+		}
+		return record_trace(handle, filename, seconds);
+	}
+
+	// stats command
+	if (0 == strcmp(command, "stats")) {
+		int	clear = (optind < argc)
+				&& (0 == strcmp(argv[optind], "clear"));
+		return show_stats(handle, clear);
+	}
+
 	// command was not interpreted
 	fprintf(stderr, "unknown command '%s'\n", command);
 	return EXIT_FAILURE;